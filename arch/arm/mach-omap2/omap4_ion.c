@@ -69,6 +69,7 @@ static struct ion_platform_data omap4_ion_data = {
 			.type = ION_HEAP_TYPE_SYSTEM,
 			.id = OMAP_ION_HEAP_SYSTEM,
 			.name = "system",
+			.flags = ION_HEAP_FLAG_DEFER_FREE,
 		},
 		{
 			.type = OMAP_ION_HEAP_TYPE_TILER_RESERVATION,
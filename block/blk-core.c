@@ -143,6 +143,7 @@ void blk_rq_init(struct request_queue *q, struct request *rq)
 	rq->ref_count = 1;
 	rq->start_time = jiffies;
 	set_start_time_ns(rq);
+	blk_rq_set_queue_time(rq);
 	rq->part = NULL;
 }
 EXPORT_SYMBOL(blk_rq_init);
@@ -1799,6 +1800,49 @@ static void blk_account_io_done(struct request *req)
 	}
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static inline int blk_latency_bucket(u64 start, u64 end)
+{
+	u64 us = end > start ? end - start : 0;
+
+	do_div(us, NSEC_PER_USEC);
+	return min_t(int, fls(min_t(u64, us, UINT_MAX)), BLK_LAT_BUCKETS - 1);
+}
+
+/*
+ * Account the time @req spent queued and on the device. Requests the
+ * driver never saw, such as an empty flush done by the flush machinery,
+ * are skipped; the flush it issued is accounted instead.
+ */
+static void blk_account_io_latency(struct request *req)
+{
+	struct gendisk *disk = req->rq_disk;
+	u64 now;
+	int op;
+
+	if (!disk || !disk->latency_hist || !req->dispatch_time_ns ||
+	    (req->cmd_type != REQ_TYPE_FS && !(req->cmd_flags & REQ_DISCARD)))
+		return;
+
+	if (req->cmd_flags & REQ_FLUSH)
+		op = BLK_LAT_FLUSH;
+	else if (req->cmd_flags & REQ_DISCARD)
+		op = BLK_LAT_DISCARD;
+	else if (rq_data_dir(req) == WRITE)
+		op = BLK_LAT_WRITE;
+	else
+		op = BLK_LAT_READ;
+
+	now = local_clock();
+	this_cpu_inc(disk->latency_hist->queue[op]
+		[blk_latency_bucket(req->queue_time_ns, req->dispatch_time_ns)]);
+	this_cpu_inc(disk->latency_hist->device[op]
+		[blk_latency_bucket(req->dispatch_time_ns, now)]);
+}
+#else
+static inline void blk_account_io_latency(struct request *req) {}
+#endif
+
 /**
  * blk_peek_request - peek at the top of a request queue
  * @q: request queue to peek at
@@ -1916,6 +1960,7 @@ void blk_dequeue_request(struct request *rq)
 	if (blk_account_rq(rq)) {
 		q->in_flight[rq_is_sync(rq)]++;
 		set_io_start_time_ns(rq);
+		blk_rq_set_dispatch_time(rq);
 	}
 }
 
@@ -2206,6 +2251,7 @@ static void blk_finish_request(struct request *req, int error)
 
 
 	blk_account_io_done(req);
+	blk_account_io_latency(req);
 
 	if (req->end_io)
 		req->end_io(req, error);
@@ -171,6 +171,21 @@ static inline int blk_cpu_to_group(int cpu)
 	return cpu;
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static inline void blk_rq_set_queue_time(struct request *rq)
+{
+	rq->queue_time_ns = local_clock();
+}
+
+static inline void blk_rq_set_dispatch_time(struct request *rq)
+{
+	rq->dispatch_time_ns = local_clock();
+}
+#else
+static inline void blk_rq_set_queue_time(struct request *rq) {}
+static inline void blk_rq_set_dispatch_time(struct request *rq) {}
+#endif
+
 /*
  * Contribute to IO statistics IFF:
  *
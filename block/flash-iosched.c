@@ -0,0 +1,683 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  For eMMC and other flash storage, where there is no seek to amortise:
+ *  nothing is ever idled on. Reads are served first, by ioprio class and
+ *  shared between blkio cgroups by weight. Writes are merged and sent in
+ *  sector-sorted batches that each cover one erase block.
+ *
+ *  See Documentation/block/flash-iosched.txt
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/iocontext.h>
+#include <linux/hash.h>
+#include "blk-cgroup.h"
+
+static const int write_expire = HZ;	/* max time before a write is submitted */
+static const int idle_expire = HZ;	/* ditto for idle class reads */
+static const int writes_starved = 4;	/* max times reads can starve writes */
+static const int erase_block_kb = 512;	/* write batches cover one of these */
+
+#define FLASH_GROUP_HASH_BITS	4
+
+enum {
+	FLASH_RT,
+	FLASH_BE,
+	FLASH_IDLE,
+	FLASH_NR_CLASSES,
+};
+
+/*
+ * The reads of one blkio cgroup in one ioprio class. Within a class,
+ * queues are served in start-time fair queueing order: each has a
+ * virtual start time that advances by the size of what it dispatched
+ * divided by its weight, and the smallest goes next. A queue that was
+ * empty restarts at the class's virtual time, so it gets no credit for
+ * the time it had nothing to read and nobody ever waits for it.
+ */
+struct flash_queue {
+	struct list_head fifo;		/* queued reads, oldest first */
+	struct list_head active;	/* in flash_data.active while queued */
+	u64 vstart;
+};
+
+/* A blkio cgroup, kept while it has read requests allocated */
+struct flash_group {
+	struct hlist_node hash;
+	void *key;			/* the blkio cgroup, never dereferenced */
+	unsigned int weight;
+	int ref;
+	struct flash_queue queue[FLASH_NR_CLASSES];
+};
+
+struct flash_data {
+	/*
+	 * run time data
+	 */
+
+	/* every request is on a sort_list, for merging and write batches */
+	struct rb_root sort_list[2];
+	struct list_head active[FLASH_NR_CLASSES];
+	u64 vtime[FLASH_NR_CLASSES];
+	struct list_head write_fifo[2];	/* async and sync writes */
+
+	struct hlist_head group_hash[1 << FLASH_GROUP_HASH_BITS];
+	struct flash_group root_group;	/* for reads not set up by us */
+
+	struct request *next_write;	/* next write in sector order */
+	sector_t batch_end;		/* end of the erase block being written */
+	int write_turn;			/* finish the batch even if reads wait */
+	unsigned int starved;		/* times reads have starved writes */
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int write_expire;
+	int idle_expire;
+	int writes_starved;
+	int erase_block_kb;
+};
+
+static void flash_move_to_dispatch(struct flash_data *, struct request *);
+
+static void flash_init_group(struct flash_group *fg, void *key,
+			     unsigned int weight)
+{
+	int i;
+
+	fg->key = key;
+	fg->weight = weight;
+	fg->ref = 0;
+	for (i = 0; i < FLASH_NR_CLASSES; i++) {
+		INIT_LIST_HEAD(&fg->queue[i].fifo);
+		INIT_LIST_HEAD(&fg->queue[i].active);
+		fg->queue[i].vstart = 0;
+	}
+}
+
+static inline struct hlist_head *
+flash_group_bucket(struct flash_data *fd, void *key)
+{
+	return &fd->group_hash[hash_ptr(key, FLASH_GROUP_HASH_BITS)];
+}
+
+static struct flash_group *flash_find_group(struct flash_data *fd, void *key)
+{
+	struct flash_group *fg;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(fg, node, flash_group_bucket(fd, key), hash)
+		if (fg->key == key)
+			return fg;
+	return NULL;
+}
+
+static inline struct flash_group *
+flash_rq_group(struct flash_data *fd, struct request *rq)
+{
+	struct flash_group *fg = rq->elevator_private[0];
+
+	return fg ? fg : &fd->root_group;
+}
+
+static inline int flash_rq_class(struct request *rq)
+{
+	switch ((unsigned long)rq->elevator_private[1]) {
+	case IOPRIO_CLASS_RT:
+		return FLASH_RT;
+	case IOPRIO_CLASS_IDLE:
+		return FLASH_IDLE;
+	default:
+		return FLASH_BE;
+	}
+}
+
+static inline struct flash_queue *
+flash_rq_queue(struct flash_data *fd, struct request *rq)
+{
+	return &flash_rq_group(fd, rq)->queue[flash_rq_class(rq)];
+}
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *flash_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+/* first write that starts at or after `sector' */
+static struct request *flash_find_write(struct flash_data *fd, sector_t sector)
+{
+	struct rb_node *n = fd->sort_list[WRITE].rb_node;
+	struct request *rq, *found = NULL;
+
+	while (n) {
+		rq = rb_entry_rq(n);
+		if (blk_rq_pos(rq) >= sector) {
+			found = rq;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
+	return found;
+}
+
+static void flash_add_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	struct request *__alias;
+
+	while (unlikely(__alias = elv_rb_add(flash_rb_root(fd, rq), rq)))
+		flash_move_to_dispatch(fd, __alias);
+}
+
+#if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_CGROUP_MODULE)
+/* current's blkio cgroup and its weight, or NULL for the root group */
+static void *flash_task_blkcg(unsigned int *weight)
+{
+	struct blkio_cgroup *blkcg;
+
+	rcu_read_lock();
+	blkcg = task_blkio_cgroup(current);
+	if (blkcg)
+		*weight = blkcg->weight;
+	rcu_read_unlock();
+
+	return blkcg;
+}
+#else
+static inline void *flash_task_blkcg(unsigned int *weight)
+{
+	return NULL;
+}
+#endif
+
+/*
+ * Remember the task's ioprio class and, for reads, its blkio cgroup;
+ * neither is known any more by the time the request is queued.
+ */
+static int
+flash_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct io_context *ioc = current->io_context;
+	struct flash_group *fg, *new = NULL;
+	unsigned int weight;
+	unsigned long flags;
+	void *blkcg;
+	int ioprio_class;
+
+	if (ioc && ioprio_valid(ioc->ioprio))
+		ioprio_class = IOPRIO_PRIO_CLASS(ioc->ioprio);
+	else
+		ioprio_class = task_nice_ioclass(current);
+	rq->elevator_private[1] = (void *)(unsigned long)ioprio_class;
+	rq->elevator_private[0] = NULL;
+
+	if (rq_data_dir(rq) != READ)
+		return 0;
+
+	blkcg = flash_task_blkcg(&weight);
+	if (!blkcg)
+		return 0;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	fg = flash_find_group(fd, blkcg);
+	if (!fg) {
+		spin_unlock_irqrestore(q->queue_lock, flags);
+		new = kmalloc_node(sizeof(*new), gfp_mask, q->node);
+		if (!new)
+			return 0;
+		flash_init_group(new, blkcg, weight);
+
+		spin_lock_irqsave(q->queue_lock, flags);
+		fg = flash_find_group(fd, blkcg);
+		if (!fg) {
+			fg = new;
+			new = NULL;
+			hlist_add_head(&fg->hash, flash_group_bucket(fd, blkcg));
+		}
+	}
+	fg->weight = weight;
+	fg->ref++;
+	spin_unlock_irqrestore(q->queue_lock, flags);
+
+	kfree(new);
+	rq->elevator_private[0] = fg;
+	return 0;
+}
+
+static void flash_put_request(struct request *rq)
+{
+	struct flash_group *fg = rq->elevator_private[0];
+
+	if (fg && !--fg->ref) {
+		hlist_del(&fg->hash);
+		kfree(fg);
+	}
+	rq->elevator_private[0] = NULL;
+}
+
+/*
+ * add rq to rbtree and to its fifo
+ */
+static void flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	flash_add_rq_rb(fd, rq);
+
+	if (rq_data_dir(rq) == READ) {
+		struct flash_queue *fq = flash_rq_queue(fd, rq);
+		int class = flash_rq_class(rq);
+
+		if (list_empty(&fq->fifo)) {
+			fq->vstart = max(fq->vstart, fd->vtime[class]);
+			list_add_tail(&fq->active, &fd->active[class]);
+		}
+		rq_set_fifo_time(rq, jiffies + fd->idle_expire);
+		list_add_tail(&rq->queuelist, &fq->fifo);
+	} else {
+		rq_set_fifo_time(rq, jiffies + fd->write_expire);
+		list_add_tail(&rq->queuelist, &fd->write_fifo[rq_is_sync(rq)]);
+	}
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct flash_data *fd, struct request *rq)
+{
+	if (fd->next_write == rq)
+		fd->next_write = flash_latter_request(rq);
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+	rq_fifo_clear(rq);
+
+	if (rq_data_dir(rq) == READ) {
+		struct flash_queue *fq = flash_rq_queue(fd, rq);
+
+		if (list_empty(&fq->fifo))
+			list_del_init(&fq->active);
+	}
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	sector_t sector = bio->bi_sector + bio_sectors(bio);
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	__rq = elv_rb_find(&fd->sort_list[bio_data_dir(bio)], sector);
+	if (__rq) {
+		BUG_ON(sector != blk_rq_pos(__rq));
+
+		if (elv_rq_merge_ok(__rq, bio)) {
+			*req = __rq;
+			return ELEVATOR_FRONT_MERGE;
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		if (fd->next_write == req)
+			fd->next_write = flash_latter_request(req);
+		elv_rb_del(flash_rb_root(fd, req), req);
+		flash_add_rq_rb(fd, req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if next expires before rq, assign its expire time to rq and move
+	 * into next position in fifo. Reads may sit in different groups'
+	 * fifos, so only writes are moved.
+	 */
+	if (rq_data_dir(req) == WRITE && rq_is_sync(req) == rq_is_sync(next) &&
+	    !list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(fd, next);
+}
+
+/*
+ * move request from sort list to dispatch queue.
+ */
+static void flash_move_to_dispatch(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	flash_remove_request(fd, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+static void flash_dispatch_read(struct flash_data *fd, struct flash_queue *fq,
+				struct flash_group *fg, int class)
+{
+	struct request *rq = rq_entry_fifo(fq->fifo.next);
+
+	fd->vtime[class] = fq->vstart;
+	fq->vstart += (u64)blk_rq_sectors(rq) * BLKIO_WEIGHT_MAX / fg->weight;
+	flash_move_to_dispatch(fd, rq);
+}
+
+static int flash_queue_expired(struct flash_queue *fq)
+{
+	struct request *rq = rq_entry_fifo(fq->fifo.next);
+
+	return time_after(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * Dispatch the next read of the highest class that has any, from the
+ * queue with the smallest virtual start time. Idle class reads only go
+ * when nothing else is queued, or once they have waited idle_expire.
+ */
+static int flash_dispatch_reads(struct flash_data *fd, int writes)
+{
+	struct flash_queue *fq, *best;
+	int class, expired;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		if (list_empty(&fd->active[class]))
+			continue;
+
+		best = NULL;
+		expired = 0;
+		list_for_each_entry(fq, &fd->active[class], active) {
+			if (!best || fq->vstart < best->vstart)
+				best = fq;
+			expired |= flash_queue_expired(fq);
+		}
+		if (class == FLASH_IDLE && writes && !expired)
+			return 0;
+
+		flash_dispatch_read(fd, best,
+				    container_of(best, struct flash_group,
+						 queue[class]), class);
+		return 1;
+	}
+	return 0;
+}
+
+static int flash_fifo_expired(struct list_head *fifo)
+{
+	return !list_empty(fifo) &&
+		time_after(jiffies, rq_fifo_time(rq_entry_fifo(fifo->next)));
+}
+
+/*
+ * Pick the erase block to write next, and return the first queued write
+ * in it. Sync writes have someone waiting on them and go first, then
+ * expired async writes, then on from the last batch in sector order.
+ */
+static struct request *flash_start_batch(struct flash_data *fd)
+{
+	sector_t erase_sectors = fd->erase_block_kb << 1;
+	struct request *rq;
+	sector_t start, tmp;
+
+	if (!list_empty(&fd->write_fifo[1]))
+		rq = rq_entry_fifo(fd->write_fifo[1].next);
+	else if (flash_fifo_expired(&fd->write_fifo[0]) || !fd->next_write)
+		rq = rq_entry_fifo(fd->write_fifo[0].next);
+	else
+		rq = fd->next_write;
+
+	start = tmp = blk_rq_pos(rq);
+	start -= sector_div(tmp, erase_sectors);
+	fd->batch_end = start + erase_sectors;
+
+	return flash_find_write(fd, start) ? : rq;
+}
+
+/*
+ * flash_dispatch_requests selects the best request: a read if there is
+ * one and writes have not been starved, otherwise the next write of the
+ * current erase block batch.
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int writes = !list_empty(&fd->write_fifo[0]) ||
+			   !list_empty(&fd->write_fifo[1]);
+	int reads = 0, class;
+	struct request *rq;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++)
+		reads |= !list_empty(&fd->active[class]);
+
+	/*
+	 * carry on with the erase block being written, unless reads
+	 * have turned up and it was not their turn to wait
+	 */
+	rq = fd->next_write;
+	if (fd->batch_end && rq && blk_rq_pos(rq) < fd->batch_end &&
+	    (fd->write_turn || !reads))
+		goto dispatch_write;
+
+	if (reads) {
+		if (writes && (fd->starved++ >= fd->writes_starved ||
+			       flash_fifo_expired(&fd->write_fifo[0]) ||
+			       flash_fifo_expired(&fd->write_fifo[1])))
+			goto dispatch_writes;
+
+		if (flash_dispatch_reads(fd, writes))
+			return 1;
+	}
+
+	if (writes) {
+dispatch_writes:
+		fd->starved = 0;
+		fd->write_turn = reads;
+		rq = flash_start_batch(fd);
+		goto dispatch_write;
+	}
+
+	return 0;
+
+dispatch_write:
+	/* the batch carries on from here in sector order */
+	fd->next_write = rq;
+	flash_move_to_dispatch(fd, rq);
+	if (!fd->next_write || blk_rq_pos(fd->next_write) >= fd->batch_end) {
+		fd->batch_end = 0;
+		fd->write_turn = 0;
+	}
+	return 1;
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+	int i;
+
+	for (i = 0; i < FLASH_NR_CLASSES; i++)
+		BUG_ON(!list_empty(&fd->active[i]));
+	BUG_ON(!list_empty(&fd->write_fifo[0]));
+	BUG_ON(!list_empty(&fd->write_fifo[1]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+	int i;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	fd->sort_list[READ] = RB_ROOT;
+	fd->sort_list[WRITE] = RB_ROOT;
+	for (i = 0; i < FLASH_NR_CLASSES; i++)
+		INIT_LIST_HEAD(&fd->active[i]);
+	INIT_LIST_HEAD(&fd->write_fifo[0]);
+	INIT_LIST_HEAD(&fd->write_fifo[1]);
+	for (i = 0; i < (1 << FLASH_GROUP_HASH_BITS); i++)
+		INIT_HLIST_HEAD(&fd->group_hash[i]);
+	flash_init_group(&fd->root_group, NULL, BLKIO_WEIGHT_DEFAULT);
+
+	fd->write_expire = write_expire;
+	fd->idle_expire = idle_expire;
+	fd->writes_starved = writes_starved;
+	fd->erase_block_kb = erase_block_kb;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_write_expire_show, fd->write_expire, 1);
+SHOW_FUNCTION(flash_idle_expire_show, fd->idle_expire, 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_erase_block_kb_show, fd->erase_block_kb, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_write_expire_store, &fd->write_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_idle_expire_store, &fd->idle_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_erase_block_kb_store, &fd->erase_block_kb, 4, 65536, 0);
+#undef STORE_FUNCTION
+
+#define FLASH_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FLASH_ATTR(write_expire),
+	FLASH_ATTR(idle_expire),
+	FLASH_ATTR(writes_starved),
+	FLASH_ATTR(erase_block_kb),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_set_req_fn =		flash_set_request,
+		.elevator_put_req_fn =		flash_put_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
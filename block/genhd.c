@@ -977,6 +977,65 @@ static ssize_t disk_discard_alignment_show(struct device *dev,
 	return sprintf(buf, "%d\n", queue_discard_alignment(disk->queue));
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static const char *disk_latency_ops[BLK_LAT_NR_OPS] = {
+	[BLK_LAT_READ]		= "read",
+	[BLK_LAT_WRITE]		= "write",
+	[BLK_LAT_DISCARD]	= "discard",
+	[BLK_LAT_FLUSH]		= "flush",
+};
+
+static ssize_t disk_latency_show(struct gendisk *disk, char *buf, int device)
+{
+	struct disk_latency_hist *hist;
+	unsigned long sum;
+	int op, i, cpu;
+	ssize_t len = 0;
+
+	for (op = 0; op < BLK_LAT_NR_OPS; op++) {
+		len += sprintf(buf + len, "%-7s", disk_latency_ops[op]);
+		for (i = 0; i < BLK_LAT_BUCKETS; i++) {
+			sum = 0;
+			for_each_possible_cpu(cpu) {
+				hist = per_cpu_ptr(disk->latency_hist, cpu);
+				sum += device ? hist->device[op][i] :
+						hist->queue[op][i];
+			}
+			len += sprintf(buf + len, " %lu", sum);
+		}
+		len += sprintf(buf + len, "\n");
+	}
+	return len;
+}
+
+/* writing anything clears both histograms */
+static ssize_t disk_latency_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct gendisk *disk = dev_to_disk(dev);
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(disk->latency_hist, cpu), 0,
+		       sizeof(struct disk_latency_hist));
+	return count;
+}
+
+static ssize_t disk_queue_latency_show(struct device *dev,
+				       struct device_attribute *attr, char *buf)
+{
+	return disk_latency_show(dev_to_disk(dev), buf, 0);
+}
+
+static ssize_t disk_device_latency_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return disk_latency_show(dev_to_disk(dev), buf, 1);
+}
+#endif
+
 static DEVICE_ATTR(range, S_IRUGO, disk_range_show, NULL);
 static DEVICE_ATTR(ext_range, S_IRUGO, disk_ext_range_show, NULL);
 static DEVICE_ATTR(removable, S_IRUGO, disk_removable_show, NULL);
@@ -988,6 +1047,12 @@ static DEVICE_ATTR(discard_alignment, S_IRUGO, disk_discard_alignment_show,
 static DEVICE_ATTR(capability, S_IRUGO, disk_capability_show, NULL);
 static DEVICE_ATTR(stat, S_IRUGO, part_stat_show, NULL);
 static DEVICE_ATTR(inflight, S_IRUGO, part_inflight_show, NULL);
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static DEVICE_ATTR(queue_latency, S_IRUGO|S_IWUSR, disk_queue_latency_show,
+		   disk_latency_store);
+static DEVICE_ATTR(device_latency, S_IRUGO|S_IWUSR, disk_device_latency_show,
+		   disk_latency_store);
+#endif
 #ifdef CONFIG_FAIL_MAKE_REQUEST
 static struct device_attribute dev_attr_fail =
 	__ATTR(make-it-fail, S_IRUGO|S_IWUSR, part_fail_show, part_fail_store);
@@ -1009,6 +1074,10 @@ static struct attribute *disk_attrs[] = {
 	&dev_attr_capability.attr,
 	&dev_attr_stat.attr,
 	&dev_attr_inflight.attr,
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	&dev_attr_queue_latency.attr,
+	&dev_attr_device_latency.attr,
+#endif
 #ifdef CONFIG_FAIL_MAKE_REQUEST
 	&dev_attr_fail.attr,
 #endif
@@ -1112,6 +1181,9 @@ static void disk_release(struct device *dev)
 	disk_replace_part_tbl(disk, NULL);
 	free_part_stats(&disk->part0);
 	free_part_info(&disk->part0);
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	free_percpu(disk->latency_hist);
+#endif
 	if (disk->queue)
 		blk_put_queue(disk->queue);
 	kfree(disk);
@@ -1297,6 +1369,15 @@ struct gendisk *alloc_disk_node(int minors, int node_id)
 			kfree(disk);
 			return NULL;
 		}
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+		disk->latency_hist = alloc_percpu(struct disk_latency_hist);
+		if (!disk->latency_hist) {
+			disk_replace_part_tbl(disk, NULL);
+			free_part_stats(&disk->part0);
+			kfree(disk);
+			return NULL;
+		}
+#endif
 		disk->part_tbl->part[0] = &disk->part0;
 
 		hd_ref_init(&disk->part0);
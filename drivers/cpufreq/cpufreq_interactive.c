@@ -63,6 +63,7 @@ struct cpufreq_interactive_cpuinfo {
 	unsigned int total_load_history;
 	unsigned int low_power_rate_history;
 	unsigned int cpu_tune_value;
+	unsigned long sched_boost;
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
@@ -122,6 +123,18 @@ static unsigned long timer_rate;
 static unsigned long default_timer_rate;
 #endif
 
+/*
+ * In sched_events mode the scheduler kicks the timer when a CPU gets busy,
+ * so the timer itself can sample less often.
+ */
+static int sched_events;
+#define DEFAULT_SCHED_TIMER_RATE (4 * DEFAULT_TIMER_RATE)
+static unsigned long sched_timer_rate;
+
+/* Evaluate speed early when a wakeup leaves this many tasks runnable. */
+#define DEFAULT_SCHED_UP_NR_RUNNING 2
+static unsigned long sched_up_nr_running;
+
 /*
  * Wait this long before raising speed above hispeed, by default a single
  * timer interval.
@@ -161,6 +174,11 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+static unsigned long cpufreq_interactive_timer_delay(void)
+{
+	return usecs_to_jiffies(sched_events ? sched_timer_rate : timer_rate);
+}
+
 #ifdef CONFIG_OMAP4_DPLL_CASCADING
 void cpufreq_interactive_set_timer_rate(unsigned long val, unsigned int reset)
 {
@@ -188,6 +206,8 @@ static void cpufreq_interactive_timer(unsigned long data)
 	unsigned int new_freq, new_tune_value;
 	unsigned int index, i, j;
 	unsigned long flags;
+	int sched_boost;
+	unsigned int boost_freq;
 
 	smp_rmb();
 
@@ -222,6 +242,11 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (delta_time < 1000)
 		goto rearm;
 
+	/* A boosted task woke up here since the last evaluation */
+	sched_boost = test_and_clear_bit(0, &pcpu->sched_boost);
+	/* Floor from the cpu cgroup freq_boost of tasks that ran here */
+	boost_freq = pcpu->policy->max * sched_cpu_freq_boost(data) / 100;
+
 	if (delta_idle > delta_time)
 		cpu_load = 0;
 	else
@@ -303,7 +328,7 @@ static void cpufreq_interactive_timer(unsigned long data)
 			cpu_load = pcpu->total_avg_load;
 	}
 
-	if (cpu_load >= go_hispeed_load || boost_val) {
+	if (cpu_load >= go_hispeed_load || boost_val || sched_boost) {
 		if (pcpu->target_freq <= pcpu->policy->min) {
 			new_freq = hispeed_freq;
 		} else {
@@ -327,6 +352,9 @@ static void cpufreq_interactive_timer(unsigned long data)
 		new_freq = pcpu->policy->max * cpu_load / 100;
 	}
 
+	if (new_freq < boost_freq)
+		new_freq = boost_freq;
+
 	if (new_freq <= hispeed_freq)
 		pcpu->hispeed_validate_time = pcpu->timer_run_time;
 
@@ -409,7 +437,7 @@ rearm:
 		pcpu->time_in_idle = get_cpu_idle_time_us(
 			data, &pcpu->idle_exit_time);
 		mod_timer(&pcpu->cpu_timer,
-			  jiffies + usecs_to_jiffies(timer_rate));
+			  jiffies + cpufreq_interactive_timer_delay());
 	}
 
 exit:
@@ -501,7 +529,7 @@ static void cpufreq_interactive_idle_start(void)
 				smp_processor_id(), &pcpu->idle_exit_time);
 			pcpu->timer_idlecancel = 0;
 			mod_timer(&pcpu->cpu_timer,
-				  jiffies + usecs_to_jiffies(timer_rate));
+				  jiffies + cpufreq_interactive_timer_delay());
 		}
 #endif
 	} else {
@@ -520,6 +548,7 @@ static void cpufreq_interactive_idle_start(void)
 			 */
 			pcpu->idle_exit_time = 0;
 			pcpu->timer_idlecancel = 0;
+			clear_bit(0, &pcpu->sched_boost);
 		}
 	}
 
@@ -552,9 +581,49 @@ static void cpufreq_interactive_idle_end(void)
 					     &pcpu->idle_exit_time);
 		pcpu->timer_idlecancel = 0;
 		mod_timer(&pcpu->cpu_timer,
-			  jiffies + usecs_to_jiffies(timer_rate));
+			  jiffies + cpufreq_interactive_timer_delay());
+	}
+
+}
+
+/*
+ * Scheduler hook. Runs under the rq lock of @cpu, so rather than waking
+ * up_task it pulls the CPU's timer in to the next tick when a task whose
+ * cpu cgroup has a freq_boost above the CPU's speed wakes up or is switched
+ * in. In sched_events mode the same is done when a wakeup left enough tasks
+ * runnable to be worth a look, or when the task is one to ramp up for
+ * straight away: a user-space real-time task, such as audio or the
+ * compositor.
+ */
+static void cpufreq_interactive_sched_event(int cpu, unsigned long nr_running,
+					    struct task_struct *p,
+					    unsigned int freq_boost)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+	int boost = 0;
+
+	if (!pcpu->governor_enabled)
+		return;
+
+	if (pcpu->policy->max * freq_boost / 100 > pcpu->target_freq) {
+		boost = 1;
+	} else if (!sched_events) {
+		return;
+	} else if (rt_task(p) && p->mm && pcpu->target_freq < hispeed_freq) {
+		set_bit(0, &pcpu->sched_boost);
+		boost = 1;
+	} else if (nr_running < sched_up_nr_running ||
+		   pcpu->target_freq >= pcpu->policy->max) {
+		return;
 	}
 
+	/* already due at the next tick */
+	if (timer_pending(&pcpu->cpu_timer) &&
+	    !time_after(pcpu->cpu_timer.expires, jiffies))
+		return;
+
+	trace_cpufreq_interactive_sched(cpu, nr_running, boost);
+	mod_timer(&pcpu->cpu_timer, jiffies);
 }
 
 static int cpufreq_interactive_up_task(void *data)
@@ -1021,7 +1090,7 @@ out:
 		pcpu = &per_cpu(cpuinfo, j);
 		if (t_mask & BIT(j))
 			mod_timer(&pcpu->cpu_timer,
-				jiffies + usecs_to_jiffies(timer_rate));
+				jiffies + cpufreq_interactive_timer_delay());
 	}
 
 	mutex_unlock(&set_speed_lock);
@@ -1099,6 +1168,74 @@ static ssize_t store_low_power_rate(struct kobject *kobj,
 static struct global_attr low_power_rate_attr = __ATTR(low_power_rate,
 		     0644, show_low_power_rate, store_low_power_rate);
 
+static ssize_t show_sched_events(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", sched_events);
+}
+
+static ssize_t store_sched_events(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+
+	sched_events = !!val;
+	return count;
+}
+
+static struct global_attr sched_events_attr = __ATTR(sched_events,
+		     0644, show_sched_events, store_sched_events);
+
+static ssize_t show_sched_timer_rate(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", sched_timer_rate);
+}
+
+static ssize_t store_sched_timer_rate(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	sched_timer_rate = val;
+	return count;
+}
+
+static struct global_attr sched_timer_rate_attr = __ATTR(sched_timer_rate,
+		     0644, show_sched_timer_rate, store_sched_timer_rate);
+
+static ssize_t show_sched_up_nr_running(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", sched_up_nr_running);
+}
+
+static ssize_t store_sched_up_nr_running(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	sched_up_nr_running = val;
+	return count;
+}
+
+static struct global_attr sched_up_nr_running_attr =
+	__ATTR(sched_up_nr_running, 0644, show_sched_up_nr_running,
+	       store_sched_up_nr_running);
+
 
 static struct attribute *interactive_attributes[] = {
 	&hispeed_freq_attr.attr,
@@ -1113,6 +1250,9 @@ static struct attribute *interactive_attributes[] = {
 	&hi_perf_threshold_attr.attr,
 	&sampling_periods_attr.attr,
 	&low_power_rate_attr.attr,
+	&sched_events_attr.attr,
+	&sched_timer_rate_attr.attr,
+	&sched_up_nr_running_attr.attr,
 	NULL,
 };
 
@@ -1172,6 +1312,8 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		if (atomic_inc_return(&active_count) > 1)
 			return 0;
 
+		sched_set_cpufreq_event(cpufreq_interactive_sched_event);
+
 		rc = sysfs_create_group(cpufreq_global_kobject,
 				&interactive_attr_group);
 		if (rc)
@@ -1207,6 +1349,8 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		if (atomic_dec_return(&active_count) > 0)
 			return 0;
 
+		sched_set_cpufreq_event(NULL);
+
 		input_unregister_handler(&cpufreq_interactive_input_handler);
 		sysfs_remove_group(cpufreq_global_kobject,
 				&interactive_attr_group);
@@ -1263,6 +1407,8 @@ static int __init cpufreq_interactive_init(void)
 	hi_perf_threshold = DEFAULT_HI_PERF_THRESHOLD;
 	low_power_threshold = DEFAULT_LOW_POWER_THRESHOLD;
 	low_power_rate = DEFAULT_LOW_POWER_RATE;
+	sched_timer_rate = DEFAULT_SCHED_TIMER_RATE;
+	sched_up_nr_running = DEFAULT_SCHED_UP_NR_RUNNING;
 	cur_tune_value = DEFAULT_TUNE;
 	/* Initalize per-cpu timers */
 	for_each_possible_cpu(i) {
@@ -16,6 +16,8 @@
 
 #include <linux/device.h>
 #include <linux/file.h>
+#include <linux/hash.h>
+#include <linux/ktime.h>
 #include <linux/fs.h>
 #include <linux/anon_inodes.h>
 #include <linux/ion.h>
@@ -59,6 +61,51 @@ static void ion_buffer_add(struct ion_device *dev,
 	rb_insert_color(&buffer->node, &dev->buffers);
 }
 
+static void ion_alloc_hist_add(struct ion_heap *heap, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket = us > 0 ? fls64(us) : 0;
+
+	if (bucket >= ION_ALLOC_HIST_BUCKETS)
+		bucket = ION_ALLOC_HIST_BUCKETS - 1;
+	atomic_inc(&heap->alloc_hist[bucket]);
+}
+
+static struct list_head *ion_recycle_bucket(struct ion_heap *heap,
+					    size_t size)
+{
+	return &heap->recycle[hash_long(size, ION_RECYCLE_BUCKETS_BITS)];
+}
+
+/*
+ * Take a buffer of exactly 'len' bytes, allocated with the same 'flags',
+ * out of the heap's recycle cache. Recycled buffers were zeroed before they
+ * went in, and their alignment is only known to be that of a page.
+ */
+static struct ion_buffer *ion_recycle_get(struct ion_heap *heap,
+					  unsigned long len,
+					  unsigned long align,
+					  unsigned long flags)
+{
+	struct ion_buffer *buffer;
+
+	if (!(heap->flags & ION_HEAP_FLAG_DEFER_FREE) || align > PAGE_SIZE)
+		return NULL;
+
+	spin_lock(&heap->free_lock);
+	list_for_each_entry(buffer, ion_recycle_bucket(heap, len), list) {
+		if (buffer->size == len && buffer->flags == flags) {
+			list_del(&buffer->list);
+			heap->recycle_size -= buffer->size;
+			heap->recycle_hits++;
+			spin_unlock(&heap->free_lock);
+			return buffer;
+		}
+	}
+	spin_unlock(&heap->free_lock);
+	return NULL;
+}
+
 /* this function should only be called while dev->lock is held */
 static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 				     struct ion_device *dev,
@@ -67,8 +114,19 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 				     unsigned long flags)
 {
 	struct ion_buffer *buffer;
+	ktime_t start;
 	int ret;
 
+	start = ktime_get();
+	buffer = ion_recycle_get(heap, len, align, flags);
+	if (buffer) {
+		ion_alloc_hist_add(heap, start);
+		kref_init(&buffer->ref);
+		buffer->cached = false;
+		ion_buffer_add(dev, buffer);
+		return buffer;
+	}
+
 	buffer = kzalloc(sizeof(struct ion_buffer), GFP_KERNEL);
 	if (!buffer)
 		return ERR_PTR(-ENOMEM);
@@ -77,11 +135,13 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	kref_init(&buffer->ref);
 
 	ret = heap->ops->allocate(heap, buffer, len, align, flags);
+	ion_alloc_hist_add(heap, start);
 	if (ret) {
 		kfree(buffer);
 		return ERR_PTR(ret);
 	}
 	buffer->dev = dev;
+	buffer->flags = flags;
 	buffer->size = len;
 	buffer->cached = false;
 	mutex_init(&buffer->lock);
@@ -89,16 +149,119 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	return buffer;
 }
 
+static void ion_buffer_free(struct ion_buffer *buffer)
+{
+	buffer->heap->ops->free(buffer);
+	kfree(buffer);
+}
+
+/*
+ * Zero a released buffer so that it can be handed to another client.
+ * Returns false if the heap can't map the buffer to do so.
+ */
+static bool ion_buffer_zero(struct ion_heap *heap, struct ion_buffer *buffer)
+{
+	void *vaddr;
+
+	if (!heap->ops->map_kernel || !heap->ops->unmap_kernel)
+		return false;
+
+	vaddr = heap->ops->map_kernel(heap, buffer);
+	if (IS_ERR_OR_NULL(vaddr))
+		return false;
+	memset(vaddr, 0, buffer->size);
+	buffer->vaddr = vaddr;
+	heap->ops->unmap_kernel(heap, buffer);
+	buffer->vaddr = NULL;
+	return true;
+}
+
+static void ion_heap_free_work(struct work_struct *work)
+{
+	struct ion_heap *heap = container_of(work, struct ion_heap, free_work);
+	struct ion_buffer *buffer;
+
+	for (;;) {
+		spin_lock(&heap->free_lock);
+		if (list_empty(&heap->free_list)) {
+			spin_unlock(&heap->free_lock);
+			break;
+		}
+		buffer = list_first_entry(&heap->free_list, struct ion_buffer,
+					  list);
+		list_del(&buffer->list);
+		spin_unlock(&heap->free_lock);
+
+		if (buffer->size <= ION_RECYCLE_LIMIT &&
+		    ion_buffer_zero(heap, buffer)) {
+			spin_lock(&heap->free_lock);
+			if (heap->recycle_size + buffer->size <=
+			    ION_RECYCLE_LIMIT) {
+				list_add(&buffer->list,
+					 ion_recycle_bucket(heap, buffer->size));
+				heap->recycle_size += buffer->size;
+				buffer = NULL;
+			}
+			spin_unlock(&heap->free_lock);
+		}
+
+		if (buffer)
+			ion_buffer_free(buffer);
+		cond_resched();
+	}
+}
+
+static int ion_heap_recycle_shrink(struct shrinker *shrinker,
+				   struct shrink_control *sc)
+{
+	struct ion_heap *heap = container_of(shrinker, struct ion_heap,
+					     recycle_shrinker);
+	struct ion_buffer *buffer;
+	int nr_to_scan = sc->nr_to_scan;
+	int i;
+
+	for (i = 0; i < ION_RECYCLE_BUCKETS && nr_to_scan > 0; i++) {
+		for (;;) {
+			spin_lock(&heap->free_lock);
+			if (list_empty(&heap->recycle[i])) {
+				spin_unlock(&heap->free_lock);
+				break;
+			}
+			buffer = list_first_entry(&heap->recycle[i],
+						  struct ion_buffer, list);
+			list_del(&buffer->list);
+			heap->recycle_size -= buffer->size;
+			spin_unlock(&heap->free_lock);
+
+			nr_to_scan -= PAGE_ALIGN(buffer->size) >> PAGE_SHIFT;
+			ion_buffer_free(buffer);
+			if (nr_to_scan <= 0)
+				break;
+		}
+	}
+
+	return ACCESS_ONCE(heap->recycle_size) >> PAGE_SHIFT;
+}
+
 static void ion_buffer_destroy(struct kref *kref)
 {
 	struct ion_buffer *buffer = container_of(kref, struct ion_buffer, ref);
 	struct ion_device *dev = buffer->dev;
+	struct ion_heap *heap = buffer->heap;
 
-	buffer->heap->ops->free(buffer);
 	mutex_lock(&dev->lock);
 	rb_erase(&buffer->node, &dev->buffers);
 	mutex_unlock(&dev->lock);
-	kfree(buffer);
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE) {
+		spin_lock(&heap->free_lock);
+		list_add_tail(&buffer->list, &heap->free_list);
+		spin_unlock(&heap->free_lock);
+		queue_work(system_unbound_wq, &heap->free_work);
+		return;
+	}
+
+	ion_buffer_free(buffer);
 }
 
 static void ion_buffer_get(struct ion_buffer *buffer)
@@ -1171,6 +1334,7 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 	struct ion_heap *heap = s->private;
 	struct ion_device *dev = heap->dev;
 	struct rb_node *n;
+	int i;
 
 	seq_printf(s, "%16.s %16.s %16.s\n", "client", "pid", "size");
 	for (n = rb_first(&dev->user_clients); n; n = rb_next(n)) {
@@ -1195,6 +1359,28 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 		seq_printf(s, "%16.s %16u %16u\n", client->name, client->pid,
 			   size);
 	}
+
+	seq_printf(s, "\nallocation latency:\n");
+	for (i = 0; i < ION_ALLOC_HIST_BUCKETS; i++) {
+		int count = atomic_read(&heap->alloc_hist[i]);
+
+		if (i < ION_ALLOC_HIST_BUCKETS - 1)
+			seq_printf(s, "  < %8u us: %u\n", 1 << i, count);
+		else
+			seq_printf(s, " >= %8u us: %u\n", 1 << (i - 1), count);
+	}
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE) {
+		spin_lock(&heap->free_lock);
+		seq_printf(s, "\nrecycle cache: %zu bytes, %lu hits\n",
+			   heap->recycle_size, heap->recycle_hits);
+		spin_unlock(&heap->free_lock);
+	}
+
+	if (heap->ops->debug_show) {
+		seq_printf(s, "\n");
+		heap->ops->debug_show(heap, s);
+	}
 	return 0;
 }
 
@@ -1215,8 +1401,20 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	struct rb_node **p = &dev->heaps.rb_node;
 	struct rb_node *parent = NULL;
 	struct ion_heap *entry;
+	int i;
 
 	heap->dev = dev;
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE) {
+		spin_lock_init(&heap->free_lock);
+		INIT_LIST_HEAD(&heap->free_list);
+		INIT_WORK(&heap->free_work, ion_heap_free_work);
+		for (i = 0; i < ION_RECYCLE_BUCKETS; i++)
+			INIT_LIST_HEAD(&heap->recycle[i]);
+		heap->recycle_shrinker.shrink = ion_heap_recycle_shrink;
+		heap->recycle_shrinker.seeks = DEFAULT_SEEKS;
+		register_shrinker(&heap->recycle_shrinker);
+	}
+
 	mutex_lock(&dev->lock);
 	while (*p) {
 		parent = *p;
@@ -1241,6 +1439,32 @@ end:
 	mutex_unlock(&dev->lock);
 }
 
+void ion_heap_deferred_teardown(struct ion_heap *heap)
+{
+	struct ion_buffer *buffer, *tmp;
+	LIST_HEAD(buffers);
+	int i;
+
+	/* only set while ion_device_add_heap()'s shrinker is registered */
+	if (!heap->recycle_shrinker.shrink)
+		return;
+	unregister_shrinker(&heap->recycle_shrinker);
+	heap->recycle_shrinker.shrink = NULL;
+
+	/* whatever the worker had not got to yet is freed below */
+	cancel_work_sync(&heap->free_work);
+
+	spin_lock(&heap->free_lock);
+	list_splice_init(&heap->free_list, &buffers);
+	for (i = 0; i < ION_RECYCLE_BUCKETS; i++)
+		list_splice_init(&heap->recycle[i], &buffers);
+	heap->recycle_size = 0;
+	spin_unlock(&heap->free_lock);
+
+	list_for_each_entry_safe(buffer, tmp, &buffers, list)
+		ion_buffer_free(buffer);
+}
+
 struct ion_device *ion_device_create(long (*custom_ioctl)
 				     (struct ion_client *client,
 				      unsigned int cmd,
@@ -1278,7 +1502,11 @@ struct ion_device *ion_device_create(long (*custom_ioctl)
 
 void ion_device_destroy(struct ion_device *dev)
 {
+	struct rb_node *n;
+
 	misc_deregister(&dev->dev);
+	for (n = rb_first(&dev->heaps); n; n = rb_next(n))
+		ion_heap_deferred_teardown(rb_entry(n, struct ion_heap, node));
 	/* XXX need to free the heaps and clients ? */
 	kfree(dev);
 }
@@ -0,0 +1,221 @@
+/*
+ * drivers/gpu/ion/ion_page_pool.c
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include "ion_priv.h"
+
+/*
+ * Chunks are handed out split into order-0 pages, so that each page can be
+ * mapped on its own, and are kept that way while they sit in the pool. The
+ * pages of a chunk stay physically contiguous, so the chunk is tracked by
+ * its first page, linked through page->lru.
+ */
+
+static void ion_page_pool_zero(struct ion_page_pool *pool, struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++)
+		clear_highpage(page + i);
+}
+
+static struct page *ion_page_pool_alloc_pages(struct ion_page_pool *pool)
+{
+	struct page *page;
+
+	page = alloc_pages(pool->gfp_mask | __GFP_ZERO, pool->order);
+	if (!page)
+		return NULL;
+	if (pool->order)
+		split_page(page, pool->order);
+	return page;
+}
+
+static void ion_page_pool_free_pages(struct ion_page_pool *pool,
+				     struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++)
+		__free_page(page + i);
+}
+
+/* Takes a chunk off 'list'. Caller must hold pool->lock. */
+static struct page *ion_page_pool_remove(struct ion_page_pool *pool,
+					 struct list_head *list, int *count)
+{
+	struct page *page;
+
+	if (list_empty(list))
+		return NULL;
+	page = list_first_entry(list, struct page, lru);
+	list_del(&page->lru);
+	(*count)--;
+	return page;
+}
+
+static void ion_page_pool_zero_work(struct work_struct *work)
+{
+	struct ion_page_pool *pool = container_of(work, struct ion_page_pool,
+						  zero_work);
+	struct page *page;
+
+	for (;;) {
+		spin_lock(&pool->lock);
+		page = ion_page_pool_remove(pool, &pool->dirty_items,
+					    &pool->dirty_count);
+		spin_unlock(&pool->lock);
+		if (!page)
+			break;
+
+		ion_page_pool_zero(pool, page);
+
+		spin_lock(&pool->lock);
+		list_add_tail(&page->lru, &pool->clean_items);
+		pool->clean_count++;
+		spin_unlock(&pool->lock);
+		cond_resched();
+	}
+}
+
+/**
+ * ion_page_pool_alloc - get a zeroed chunk of 2^order pages
+ *
+ * Zeroed chunks are preferred, then freed chunks (zeroed here), and only
+ * then does the chunk come from the page allocator.
+ */
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
+{
+	struct page *page;
+	bool dirty = false;
+
+	spin_lock(&pool->lock);
+	page = ion_page_pool_remove(pool, &pool->clean_items,
+				    &pool->clean_count);
+	if (!page) {
+		page = ion_page_pool_remove(pool, &pool->dirty_items,
+					    &pool->dirty_count);
+		dirty = true;
+	}
+	spin_unlock(&pool->lock);
+
+	if (!page)
+		return ion_page_pool_alloc_pages(pool);
+	if (dirty)
+		ion_page_pool_zero(pool, page);
+	return page;
+}
+
+/**
+ * ion_page_pool_free - give a chunk back to the pool, to be zeroed later
+ */
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
+{
+	spin_lock(&pool->lock);
+	list_add_tail(&page->lru, &pool->dirty_items);
+	pool->dirty_count++;
+	spin_unlock(&pool->lock);
+
+	queue_work(system_unbound_wq, &pool->zero_work);
+}
+
+/**
+ * ion_page_pool_total - number of pages held by the pool
+ */
+int ion_page_pool_total(struct ion_page_pool *pool)
+{
+	int count;
+
+	spin_lock(&pool->lock);
+	count = pool->clean_count + pool->dirty_count;
+	spin_unlock(&pool->lock);
+
+	return count << pool->order;
+}
+
+/**
+ * ion_page_pool_shrink - release up to nr_to_scan pages to the system
+ *
+ * Chunks still waiting to be zeroed go first. Returns the number of pages
+ * released.
+ */
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan)
+{
+	struct page *page;
+	int freed = 0;
+
+	while (freed < nr_to_scan) {
+		spin_lock(&pool->lock);
+		page = ion_page_pool_remove(pool, &pool->dirty_items,
+					    &pool->dirty_count);
+		if (!page)
+			page = ion_page_pool_remove(pool, &pool->clean_items,
+						    &pool->clean_count);
+		spin_unlock(&pool->lock);
+		if (!page)
+			break;
+
+		ion_page_pool_free_pages(pool, page);
+		freed += 1 << pool->order;
+	}
+
+	return freed;
+}
+
+void ion_page_pool_debug_show(struct ion_page_pool *pool, struct seq_file *s)
+{
+	int clean, dirty;
+
+	spin_lock(&pool->lock);
+	clean = pool->clean_count;
+	dirty = pool->dirty_count;
+	spin_unlock(&pool->lock);
+
+	seq_printf(s, "order %2u: %6d zeroed %6d dirty chunks, %8lu bytes\n",
+		   pool->order, clean, dirty,
+		   (unsigned long)(clean + dirty) * (PAGE_SIZE << pool->order));
+}
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
+{
+	struct ion_page_pool *pool;
+
+	pool = kzalloc(sizeof(struct ion_page_pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->order = order;
+	pool->gfp_mask = gfp_mask;
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->clean_items);
+	INIT_LIST_HEAD(&pool->dirty_items);
+	INIT_WORK(&pool->zero_work, ion_page_pool_zero_work);
+	return pool;
+}
+
+void ion_page_pool_destroy(struct ion_page_pool *pool)
+{
+	cancel_work_sync(&pool->zero_work);
+	ion_page_pool_shrink(pool, INT_MAX);
+	kfree(pool);
+}
@@ -18,13 +18,17 @@
 #define _ION_PRIV_H
 
 #include <linux/kref.h>
+#include <linux/mm.h>
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #include <linux/ion.h>
 #include <linux/miscdevice.h>
 
 struct ion_mapping;
+struct seq_file;
 
 struct ion_dma_mapping {
 	struct kref ref;
@@ -126,6 +130,7 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
  * @vaddr:		the kenrel mapping if kmap_cnt is not zero
  * @dmap_cnt:		number of times the buffer is mapped for dma
  * @sglist:		the scatterlist for the buffer is dmap_cnt is not zero
+ * @list:		entry in the heap's deferred free list or recycle cache
 */
 struct ion_buffer {
 	struct kref ref;
@@ -144,6 +149,7 @@ struct ion_buffer {
 	int dmap_cnt;
 	struct scatterlist *sglist;
 	bool cached;
+	struct list_head list;
 };
 
 /**
@@ -159,6 +165,7 @@ struct ion_buffer {
  * @map_user		map memory to userspace
  * @flush_user		flush memory if mapped as cacheable
  * @inval_user		invalidate memory if mapped as cacheable
+ * @debug_show		show heap specific state in the heap's debugfs file
  */
 struct ion_heap_ops {
 	int (*allocate) (struct ion_heap *heap,
@@ -178,8 +185,22 @@ struct ion_heap_ops {
 			unsigned long vaddr);
 	int (*inval_user) (struct ion_buffer *buffer, size_t len,
 			unsigned long vaddr);
+	void (*debug_show) (struct ion_heap *heap, struct seq_file *s);
 };
 
+/*
+ * Allocation latency histogram buckets: bucket 0 counts allocations that
+ * took under 1us, bucket n those that took [2^(n-1), 2^n) us, and the last
+ * bucket everything slower.
+ */
+#define ION_ALLOC_HIST_BUCKETS	16
+
+#define ION_RECYCLE_BUCKETS_BITS	4
+#define ION_RECYCLE_BUCKETS		(1 << ION_RECYCLE_BUCKETS_BITS)
+
+/* Most bytes a heap keeps in its recycle cache */
+#define ION_RECYCLE_LIMIT		(32 << 20)
+
 /**
  * struct ion_heap - represents a heap in the system
  * @node:		rb node to put the heap on the device's tree of heaps
@@ -190,6 +211,16 @@ struct ion_heap_ops {
  *			allocating.  These are specified by platform data and
  *			MUST be unique
  * @name:		used for debugging
+ * @alloc_hist:		histogram of allocation latencies, see
+ *			ION_ALLOC_HIST_BUCKETS
+ * @flags:		ION_HEAP_FLAG_* flags of the heap
+ * @free_lock:		protects free_list and the recycle cache
+ * @free_list:		buffers waiting to be released by free_work
+ * @free_work:		releases buffers of ION_HEAP_FLAG_DEFER_FREE heaps
+ * @recycle:		released buffers kept for reuse, hashed by size
+ * @recycle_size:	total size of the buffers in the recycle cache
+ * @recycle_hits:	allocations served from the recycle cache
+ * @recycle_shrinker:	empties the recycle cache under memory pressure
  *
  * Represents a pool of memory from which buffers can be made.  In some
  * systems the only heap is regular system memory allocated via vmalloc.
@@ -203,6 +234,15 @@ struct ion_heap {
 	struct ion_heap_ops *ops;
 	int id;
 	const char *name;
+	atomic_t alloc_hist[ION_ALLOC_HIST_BUCKETS];
+	unsigned long flags;
+	spinlock_t free_lock;
+	struct list_head free_list;
+	struct work_struct free_work;
+	struct list_head recycle[ION_RECYCLE_BUCKETS];
+	size_t recycle_size;
+	unsigned long recycle_hits;
+	struct shrinker recycle_shrinker;
 };
 
 /**
@@ -229,6 +269,15 @@ void ion_device_destroy(struct ion_device *dev);
  */
 void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap);
 
+/**
+ * ion_heap_deferred_teardown - stop deferred freeing on a heap
+ * @heap:		the heap
+ *
+ * Must be called before an ION_HEAP_FLAG_DEFER_FREE heap is freed, once
+ * it has no live buffers. Does nothing for other heaps or if called twice.
+ */
+void ion_heap_deferred_teardown(struct ion_heap *heap);
+
 /**
  * functions for creating and destroying the built in ion heaps.
  * architectures can add their own custom architecture specific
@@ -254,6 +303,41 @@ ion_phys_addr_t ion_carveout_allocate(struct ion_heap *heap, unsigned long size,
 				      unsigned long align);
 void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 		       unsigned long size);
+/**
+ * struct ion_page_pool - pagepool struct
+ * @order:		order of the chunks in the pool
+ * @gfp_mask:		gfp mask to allocate new chunks with
+ * @lock:		protects the lists and counts
+ * @clean_items:	zeroed chunks, ready to be handed out
+ * @clean_count:	number of chunks on clean_items
+ * @dirty_items:	freed chunks waiting to be zeroed
+ * @dirty_count:	number of chunks on dirty_items
+ * @zero_work:		zeroes dirty chunks in the background
+ *
+ * Allocating and zeroing a set of pages is expensive, especially at higher
+ * orders.  A page pool keeps freed chunks of a single order around, zeroes
+ * them off the allocation path and hands them out again.  The pool is
+ * drained by its heap's shrinker under memory pressure.
+ */
+struct ion_page_pool {
+	unsigned int order;
+	gfp_t gfp_mask;
+	spinlock_t lock;
+	struct list_head clean_items;
+	int clean_count;
+	struct list_head dirty_items;
+	int dirty_count;
+	struct work_struct zero_work;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
+void ion_page_pool_destroy(struct ion_page_pool *);
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+int ion_page_pool_total(struct ion_page_pool *);
+int ion_page_pool_shrink(struct ion_page_pool *, int nr_to_scan);
+void ion_page_pool_debug_show(struct ion_page_pool *, struct seq_file *);
+
 /**
  * The carveout heap returns physical addresses, since 0 may be a valid
  * physical address, this is used to indicate allocation failed
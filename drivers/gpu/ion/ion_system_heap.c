@@ -18,37 +18,96 @@
 #include <linux/ion.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include "ion_priv.h"
 
+/*
+ * Buffers are built from the largest chunks that fit, taken from one page
+ * pool per order.  High order chunks are tried without retrying or warning,
+ * falling back to smaller ones when memory is fragmented.
+ */
+static const unsigned int orders[] = {8, 4, 0};
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+struct ion_system_heap {
+	struct ion_heap heap;
+	struct ion_page_pool *pools[NUM_ORDERS];
+	struct shrinker shrinker;
+};
+
+/*
+ * priv_virt holds the buffer's order-0 pages.  The first page of each chunk
+ * records the chunk's order in page_private.
+ */
+#define chunk_order(page)	((unsigned int)page_private(page))
+
+static struct page *alloc_largest_available(struct ion_system_heap *heap,
+					    int pages_remaining)
+{
+	struct page *page;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (pages_remaining < (1 << orders[i]))
+			continue;
+
+		page = ion_page_pool_alloc(heap->pools[i]);
+		if (!page)
+			continue;
+		set_page_private(page, orders[i]);
+		return page;
+	}
+
+	return NULL;
+}
+
+static void free_chunk(struct ion_system_heap *heap, struct page *page)
+{
+	unsigned int order = chunk_order(page);
+	int i;
+
+	set_page_private(page, 0);
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (orders[i] == order) {
+			ion_page_pool_free(heap->pools[i], page);
+			return;
+		}
+	}
+}
+
 static int ion_system_heap_allocate(struct ion_heap *heap,
 				    struct ion_buffer *buffer,
 				    unsigned long size, unsigned long align,
 				    unsigned long flags)
 {
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
 	int n_pages = PAGE_ALIGN(size) / PAGE_SIZE;
 	struct page **page_list;
-	const int gfp_mask = GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO;
-	int i = 0;
+	struct page *page;
+	int i = 0, j;
 
 	page_list = kmalloc(n_pages * sizeof(void *), GFP_KERNEL);
+	if (!page_list)
+		return -ENOMEM;
 
-	for (i = 0; i < n_pages; i++) {
-		page_list[i] = alloc_page(gfp_mask);
-		if (page_list[i] == NULL)
+	while (i < n_pages) {
+		page = alloc_largest_available(sys_heap, n_pages - i);
+		if (!page)
 			goto out;
+		for (j = 0; j < (1 << chunk_order(page)); j++)
+			page_list[i++] = page + j;
 	}
 
 	buffer->priv_virt = page_list;
 	return 0;
 
 out:
-	/* failed on i, so go to i-1 */
-	i--;
-
-	for (; i >= 0; i--)
-		__free_page(page_list[i]);
+	for (j = 0; j < i; j += 1 << chunk_order(page_list[j]))
+		free_chunk(sys_heap, page_list[j]);
 
 	kfree(page_list);
 	return -ENOMEM;
@@ -56,12 +115,15 @@ out:
 
 void ion_system_heap_free(struct ion_buffer *buffer)
 {
+	struct ion_system_heap *sys_heap = container_of(buffer->heap,
+							struct ion_system_heap,
+							heap);
 	int i;
 	int n_pages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
 	struct page **page_list = (struct page **)buffer->priv_virt;
 
-	for (i = 0; i < n_pages; i++)
-		__free_page(page_list[i]);
+	for (i = 0; i < n_pages; i += 1 << chunk_order(page_list[i]))
+		free_chunk(sys_heap, page_list[i]);
 	kfree(page_list);
 }
 
@@ -70,16 +132,21 @@ struct scatterlist *ion_system_heap_map_dma(struct ion_heap *heap,
 {
 	struct scatterlist *sglist;
 	struct page **page_list = (struct page **)buffer->priv_virt;
-	int i;
+	int i, n_chunks = 0;
 	int n_pages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
 
-	sglist = vmalloc(n_pages * sizeof(struct scatterlist));
+	for (i = 0; i < n_pages; i += 1 << chunk_order(page_list[i]))
+		n_chunks++;
+
+	sglist = vmalloc(n_chunks * sizeof(struct scatterlist));
 	if (!sglist)
 		return ERR_PTR(-ENOMEM);
-	memset(sglist, 0, n_pages * sizeof(struct scatterlist));
-	sg_init_table(sglist, n_pages);
-	for (i = 0; i < n_pages; i++)
-		sg_set_page(&sglist[i], page_list[i], PAGE_SIZE, 0);
+	memset(sglist, 0, n_chunks * sizeof(struct scatterlist));
+	sg_init_table(sglist, n_chunks);
+	for (i = 0, n_chunks = 0; i < n_pages;
+	     i += 1 << chunk_order(page_list[i]))
+		sg_set_page(&sglist[n_chunks++], page_list[i],
+			    PAGE_SIZE << chunk_order(page_list[i]), 0);
 	/* XXX do cache maintenance for dma? */
 	return sglist;
 }
@@ -137,6 +204,18 @@ int ion_system_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 	return 0;
 }
 
+static void ion_system_heap_debug_show(struct ion_heap *heap,
+				       struct seq_file *s)
+{
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_debug_show(sys_heap->pools[i], s);
+}
+
 static struct ion_heap_ops vmalloc_ops = {
 	.allocate = ion_system_heap_allocate,
 	.free = ion_system_heap_free,
@@ -145,23 +224,72 @@ static struct ion_heap_ops vmalloc_ops = {
 	.map_kernel = ion_system_heap_map_kernel,
 	.unmap_kernel = ion_system_heap_unmap_kernel,
 	.map_user = ion_system_heap_map_user,
+	.debug_show = ion_system_heap_debug_show,
 };
 
+/* Smallest chunks are given back first, they are the cheapest to refill */
+static int ion_system_heap_shrink(struct shrinker *shrinker,
+				  struct shrink_control *sc)
+{
+	struct ion_system_heap *sys_heap = container_of(shrinker,
+							struct ion_system_heap,
+							shrinker);
+	int nr_to_scan = sc->nr_to_scan;
+	int i, total = 0;
+
+	for (i = NUM_ORDERS - 1; i >= 0 && nr_to_scan > 0; i--)
+		nr_to_scan -= ion_page_pool_shrink(sys_heap->pools[i],
+						   nr_to_scan);
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		total += ion_page_pool_total(sys_heap->pools[i]);
+	return total;
+}
+
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused)
 {
-	struct ion_heap *heap;
+	struct ion_system_heap *sys_heap;
+	int i;
 
-	heap = kzalloc(sizeof(struct ion_heap), GFP_KERNEL);
-	if (!heap)
+	sys_heap = kzalloc(sizeof(struct ion_system_heap), GFP_KERNEL);
+	if (!sys_heap)
 		return ERR_PTR(-ENOMEM);
-	heap->ops = &vmalloc_ops;
-	heap->type = ION_HEAP_TYPE_SYSTEM;
-	return heap;
+	sys_heap->heap.ops = &vmalloc_ops;
+	sys_heap->heap.type = ION_HEAP_TYPE_SYSTEM;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		gfp_t gfp_flags = GFP_KERNEL | __GFP_HIGHMEM;
+
+		if (orders[i])
+			gfp_flags |= __GFP_NORETRY | __GFP_NOWARN;
+		sys_heap->pools[i] = ion_page_pool_create(gfp_flags, orders[i]);
+		if (!sys_heap->pools[i])
+			goto err;
+	}
+
+	sys_heap->shrinker.shrink = ion_system_heap_shrink;
+	sys_heap->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&sys_heap->shrinker);
+	return &sys_heap->heap;
+
+err:
+	while (--i >= 0)
+		ion_page_pool_destroy(sys_heap->pools[i]);
+	kfree(sys_heap);
+	return ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_destroy(struct ion_heap *heap)
 {
-	kfree(heap);
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	int i;
+
+	unregister_shrinker(&sys_heap->shrinker);
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_destroy(sys_heap->pools[i]);
+	kfree(sys_heap);
 }
 
 static int ion_system_contig_heap_allocate(struct ion_heap *heap,
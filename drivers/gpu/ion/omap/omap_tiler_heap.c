@@ -473,7 +473,7 @@ struct ion_heap *omap_tiler_heap_create(struct ion_platform_heap *data)
 
 	if ((data->id == OMAP_ION_HEAP_TILER) ||
 	    (data->id == OMAP_ION_HEAP_NONSECURE_TILER)) {
-		heap->pool = gen_pool_create(12, -1);
+		heap->pool = gen_pool_create_best_fit(12, -1);
 		if (!heap->pool) {
 			kfree(heap);
 			return ERR_PTR(-ENOMEM);
@@ -485,6 +485,7 @@ struct ion_heap *omap_tiler_heap_create(struct ion_platform_heap *data)
 	heap->heap.type = OMAP_ION_HEAP_TYPE_TILER;
 	heap->heap.name = data->name;
 	heap->heap.id = data->id;
+	heap->heap.flags = data->flags;
 
 	if (omap_total_ram_size() <= SZ_512M)
 		use_dynamic_pages = true;
@@ -497,6 +498,8 @@ struct ion_heap *omap_tiler_heap_create(struct ion_platform_heap *data)
 void omap_tiler_heap_destroy(struct ion_heap *heap)
 {
 	struct omap_ion_heap *omap_ion_heap = (struct omap_ion_heap *)heap;
+
+	ion_heap_deferred_teardown(heap);
 	if (omap_ion_heap->pool)
 		gen_pool_destroy(omap_ion_heap->pool);
 	kfree(heap);
@@ -80,6 +80,8 @@ struct sita_pvt {
 	struct mutex mtx;
 	struct tcm_pt div_pt;	/* divider point splitting container */
 	struct tcm_area ***map;	/* pointers to the parent area for each slot */
+	u16 **free_run;		/* free_run[y][x]: number of consecutive free
+				   slots in row y starting at column x */
 };
 
 #endif
@@ -72,7 +72,8 @@ static s32 scan_r2l_b2t_one_dim(struct tcm *tcm, u32 num_slots,
 /*********************************************
  *	Support Infrastructure Methods
  *********************************************/
-static s32 is_area_free(struct tcm_area ***map, u16 x0, u16 y0, u16 w, u16 h);
+static s32 is_area_free(struct sita_pvt *pvt, u16 x0, u16 y0, u16 w, u16 h,
+			s32 *busy_x);
 
 static s32 update_candidate(struct tcm *tcm, u16 x0, u16 y0, u16 w, u16 h,
 			    struct tcm_area *field, s32 criteria,
@@ -139,6 +140,24 @@ struct tcm *sita_init(u16 width, u16 height, struct tcm_pt *attr)
 		}
 	}
 
+	/* Creating free run index, one row at a time */
+	pvt->free_run = kmalloc(sizeof(*pvt->free_run) * tcm->height,
+								GFP_KERNEL);
+	if (!pvt->free_run)
+		goto error_map;
+
+	for (i = 0; i < tcm->height; i++) {
+		pvt->free_run[i] =
+			kmalloc(sizeof(**pvt->free_run) * tcm->width,
+								GFP_KERNEL);
+		if (pvt->free_run[i] == NULL) {
+			while (i--)
+				kfree(pvt->free_run[i]);
+			kfree(pvt->free_run);
+			goto error_map;
+		}
+	}
+
 	if (attr && attr->x <= tcm->width && attr->y <= tcm->height) {
 		pvt->div_pt.x = attr->x;
 		pvt->div_pt.y = attr->y;
@@ -156,6 +175,10 @@ struct tcm *sita_init(u16 width, u16 height, struct tcm_pt *attr)
 	mutex_unlock(&(pvt->mtx));
 	return tcm;
 
+error_map:
+	for (i = 0; i < tcm->width; i++)
+		kfree(pvt->map[i]);
+	kfree(pvt->map);
 error:
 	kfree(tcm);
 	kfree(pvt);
@@ -180,6 +203,9 @@ static void sita_deinit(struct tcm *tcm)
 	for (i = 0; i < tcm->height; i++)
 		kfree(pvt->map[i]);
 	kfree(pvt->map);
+	for (i = 0; i < tcm->height; i++)
+		kfree(pvt->free_run[i]);
+	kfree(pvt->free_run);
 	kfree(pvt);
 }
 
@@ -295,9 +321,9 @@ static s32 sita_free(struct tcm *tcm, struct tcm_area *area)
 static s32 scan_r2l_t2b(struct tcm *tcm, u16 w, u16 h, u16 align,
 			struct tcm_area *field, struct tcm_area *area)
 {
-	s32 x, y;
+	s32 x, y, busy_x;
 	s16 start_x, end_x, start_y, end_y, found_x = -1;
-	struct tcm_area ***map = ((struct sita_pvt *)tcm->pvt)->map;
+	struct sita_pvt *pvt = (struct sita_pvt *)tcm->pvt;
 	struct score best = {{0}, {0}, {0}, 0};
 
 	PA(2, "scan_r2l_t2b:", field);
@@ -329,7 +355,7 @@ static s32 scan_r2l_t2b(struct tcm *tcm, u16 w, u16 h, u16 align,
 	/* scan field top-to-bottom, right-to-left */
 	for (y = start_y; y <= end_y; y++) {
 		for (x = start_x; x >= end_x; x -= align) {
-			if (is_area_free(map, x, y, w, h)) {
+			if (is_area_free(pvt, x, y, w, h, &busy_x)) {
 				P3("found shoulder: %d,%d", x, y);
 				found_x = x;
 
@@ -343,9 +369,9 @@ static s32 scan_r2l_t2b(struct tcm *tcm, u16 w, u16 h, u16 align,
 				end_x = x + 1;
 #endif
 				break;
-			} else if (map[x][y] && map[x][y]->is2d) {
-				/* step over 2D areas */
-				x = ALIGN(map[x][y]->p0.x - w + 1, align);
+			} else {
+				/* step over the busy slot */
+				x = ALIGN(busy_x - w + 1, align);
 				P3("moving to: %d,%d", x, y);
 			}
 		}
@@ -382,9 +408,9 @@ static s32 scan_r2l_b2t(struct tcm *tcm, u16 w, u16 h, u16 align,
 	/* TODO: Should I check scan area?
 	 * Might have to take it as input during initialization
 	 */
-	s32 x, y;
+	s32 x, y, busy_x;
 	s16 start_x, end_x, start_y, end_y, found_x = -1;
-	struct tcm_area ***map = ((struct sita_pvt *)tcm->pvt)->map;
+	struct sita_pvt *pvt = (struct sita_pvt *)tcm->pvt;
 	struct score best = {{0}, {0}, {0}, 0};
 
 	PA(2, "scan_r2l_b2t:", field);
@@ -416,7 +442,7 @@ static s32 scan_r2l_b2t(struct tcm *tcm, u16 w, u16 h, u16 align,
 	/* scan field bottom-to-top, right-to-left */
 	for (y = start_y; y >= end_y; y--) {
 		for (x = start_x; x >= end_x; x -= align) {
-			if (is_area_free(map, x, y, w, h)) {
+			if (is_area_free(pvt, x, y, w, h, &busy_x)) {
 				P3("found shoulder: %d,%d", x, y);
 				found_x = x;
 
@@ -429,9 +455,9 @@ static s32 scan_r2l_b2t(struct tcm *tcm, u16 w, u16 h, u16 align,
 				end_x = x + 1;
 #endif
 				break;
-			} else if (map[x][y] && map[x][y]->is2d) {
-				/* step over 2D areas */
-				x = ALIGN(map[x][y]->p0.x - w + 1, align);
+			} else {
+				/* step over the busy slot */
+				x = ALIGN(busy_x - w + 1, align);
 				P3("moving to: %d,%d", x, y);
 			}
 		}
@@ -465,9 +491,9 @@ done:
 static s32 scan_l2r_t2b(struct tcm *tcm, u16 w, u16 h, u16 align,
 			struct tcm_area *field, struct tcm_area *area)
 {
-	s32 x, y;
+	s32 x, y, busy_x;
 	s16 start_x, end_x, start_y, end_y, found_x = -1;
-	struct tcm_area ***map = ((struct sita_pvt *)tcm->pvt)->map;
+	struct sita_pvt *pvt = (struct sita_pvt *)tcm->pvt;
 	struct score best = {{0}, {0}, {0}, 0};
 
 	PA(2, "scan_l2r_t2b:", field);
@@ -501,7 +527,7 @@ static s32 scan_l2r_t2b(struct tcm *tcm, u16 w, u16 h, u16 align,
 	/* scan field top-to-bottom, left-to-right */
 	for (y = start_y; y <= end_y; y++) {
 		for (x = start_x; x <= end_x; x += align) {
-			if (is_area_free(map, x, y, w, h)) {
+			if (is_area_free(pvt, x, y, w, h, &busy_x)) {
 				P3("found shoulder: %d,%d", x, y);
 				found_x = x;
 
@@ -514,9 +540,9 @@ static s32 scan_l2r_t2b(struct tcm *tcm, u16 w, u16 h, u16 align,
 				end_x = x - 1;
 #endif
 				break;
-			} else if (map[x][y] && map[x][y]->is2d) {
-				/* step over 2D areas */
-				x = ALIGN_DOWN(map[x][y]->p1.x, align);
+			} else {
+				/* step over the busy slot */
+				x = ALIGN_DOWN(busy_x, align);
 				P3("moving to: %d,%d", x, y);
 			}
 		}
@@ -550,9 +576,9 @@ done:
 static s32 scan_l2r_b2t(struct tcm *tcm, u16 w, u16 h, u16 align,
 			struct tcm_area *field, struct tcm_area *area)
 {
-	s32 x, y;
+	s32 x, y, busy_x;
 	s16 start_x, end_x, start_y, end_y, found_x = -1;
-	struct tcm_area ***map = ((struct sita_pvt *)tcm->pvt)->map;
+	struct sita_pvt *pvt = (struct sita_pvt *)tcm->pvt;
 	struct score best = {{0}, {0}, {0}, 0};
 
 	PA(2, "scan_l2r_b2t:", field);
@@ -586,7 +612,7 @@ static s32 scan_l2r_b2t(struct tcm *tcm, u16 w, u16 h, u16 align,
 	/* scan field bottom-to-top, left-to-right */
 	for (y = start_y; y >= end_y; y--) {
 		for (x = start_x; x <= end_x; x += align) {
-			if (is_area_free(map, x, y, w, h)) {
+			if (is_area_free(pvt, x, y, w, h, &busy_x)) {
 				P3("found shoulder: %d,%d", x, y);
 				found_x = x;
 
@@ -599,9 +625,9 @@ static s32 scan_l2r_b2t(struct tcm *tcm, u16 w, u16 h, u16 align,
 				end_x = x - 1;
 #endif
 				break;
-			} else if (map[x][y] && map[x][y]->is2d) {
-				/* step over 2D areas */
-				x = ALIGN_DOWN(map[x][y]->p1.x, align);
+			} else {
+				/* step over the busy slot */
+				x = ALIGN_DOWN(busy_x, align);
 				P3("moving to: %d,%d", x, y);
 			}
 		}
@@ -769,14 +795,19 @@ static s32 scan_areas_and_find_fit(struct tcm *tcm, u16 w, u16 h, u16 align,
 	return ret;
 }
 
-/* check if an entire area is free */
-static s32 is_area_free(struct tcm_area ***map, u16 x0, u16 y0, u16 w, u16 h)
+/*
+ * check if an entire area is free; if not, return the column of a busy slot
+ * within it in busy_x, so that the scanners can step over it
+ */
+static s32 is_area_free(struct sita_pvt *pvt, u16 x0, u16 y0, u16 w, u16 h,
+			s32 *busy_x)
 {
-	u16 x = 0, y = 0;
+	u16 y;
+
 	for (y = y0; y < y0 + h; y++) {
-		for (x = x0; x < x0 + w; x++) {
-			if (map[x][y])
-				return false;
+		if (pvt->free_run[y][x0] < w) {
+			*busy_x = x0 + pvt->free_run[y][x0];
+			return false;
 		}
 	}
 	return true;
@@ -799,6 +830,28 @@ static void fill_area(struct tcm *tcm, struct tcm_area *area,
 			for (y = a.p0.y; y <= a.p1.y; ++y)
 				pvt->map[x][y] = parent;
 
+		/*
+		 * update the free runs of the slice and of the run that ends
+		 * just left of it. The leftward walk can cover the whole row,
+		 * so this costs up to the container width per row of the
+		 * slice, more than the fill itself; it runs once per reserve
+		 * or free, while is_area_free() runs for every candidate.
+		 */
+		for (y = a.p0.y; y <= a.p1.y; ++y) {
+			u16 *run = pvt->free_run[y];
+
+			for (x = a.p1.x; x >= 0; --x) {
+				if (pvt->map[x][y])
+					run[x] = 0;
+				else if (x == tcm->width - 1)
+					run[x] = 1;
+				else
+					run[x] = run[x + 1] + 1;
+
+				if (x < a.p0.x && !run[x])
+					break;
+			}
+		}
 	}
 }
 
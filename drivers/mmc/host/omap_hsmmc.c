@@ -195,6 +195,12 @@ struct adma_desc_table {
 	dma_addr_t addr;
 };
 
+/* Buffers of the next request, mapped while the current one transfers */
+struct omap_hsmmc_next {
+	unsigned int		dma_len;
+	s32			cookie;
+};
+
 struct omap_hsmmc_host {
 	struct	device		*dev;
 	struct	mmc_host	*mmc;
@@ -225,6 +231,7 @@ struct omap_hsmmc_host {
 	unsigned int		id;
 	unsigned int		dma_len;
 	unsigned int		dma_sg_idx;
+	struct omap_hsmmc_next	next_data;
 	unsigned int		master_clock;
 	unsigned char		bus_mode;
 	unsigned char		power_mode;
@@ -1026,6 +1033,56 @@ omap_hsmmc_get_dma_dir(struct omap_hsmmc_host *host, struct mmc_data *data)
 		return DMA_FROM_DEVICE;
 }
 
+/*
+ * Map the buffers of @data for DMA. With @next this is done ahead of
+ * time, from omap_hsmmc_pre_req(), and tagged with a cookie; without,
+ * a mapping made that way is picked up instead of mapping again.
+ */
+static int omap_hsmmc_pre_dma_transfer(struct omap_hsmmc_host *host,
+				       struct mmc_data *data,
+				       struct omap_hsmmc_next *next)
+{
+	int dma_len;
+
+	if (!next && data->host_cookie &&
+	    data->host_cookie == host->next_data.cookie) {
+		dma_len = host->next_data.dma_len;
+		host->next_data.dma_len = 0;
+	} else {
+		if (!next && data->host_cookie) {
+			dev_warn(mmc_dev(host->mmc),
+				 "invalid cookie %d, expected %d\n",
+				 data->host_cookie, host->next_data.cookie);
+			data->host_cookie = 0;
+		}
+		dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
+				     data->sg_len,
+				     omap_hsmmc_get_dma_dir(host, data));
+	}
+
+	if (dma_len == 0)
+		return -EINVAL;
+
+	if (next) {
+		next->dma_len = dma_len;
+		if (++next->cookie <= 0)
+			next->cookie = 1;
+		data->host_cookie = next->cookie;
+	} else {
+		host->dma_len = dma_len;
+	}
+	return 0;
+}
+
+/* Buffers mapped ahead of time are unmapped by omap_hsmmc_post_req() */
+static void omap_hsmmc_dma_unmap(struct omap_hsmmc_host *host,
+				 struct mmc_data *data)
+{
+	if (!data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+			     omap_hsmmc_get_dma_dir(host, data));
+}
+
 static void omap_hsmmc_request_done(struct omap_hsmmc_host *host, struct mmc_request *mrq)
 {
 	int dma_ch;
@@ -1066,8 +1123,7 @@ omap_hsmmc_xfer_done(struct omap_hsmmc_host *host, struct mmc_data *data)
 	host->data = NULL;
 
 	if (host->dma_type == ADMA_XFER)
-		dma_unmap_sg(mmc_dev(host->mmc), data->sg, host->dma_len,
-					omap_hsmmc_get_dma_dir(host, data));
+		omap_hsmmc_dma_unmap(host, data);
 
 	if (!data->error)
 		data->bytes_xfered += data->blocks * (data->blksz);
@@ -1167,9 +1223,7 @@ static void omap_hsmmc_dma_cleanup(struct omap_hsmmc_host *host, int errno)
 	spin_unlock(&host->irq_lock);
 
 	if ((host->dma_type == SDMA_XFER) && (dma_ch != -1)) {
-		dma_unmap_sg(mmc_dev(host->mmc), host->data->sg,
-			host->data->sg_len,
-			omap_hsmmc_get_dma_dir(host, host->data));
+		omap_hsmmc_dma_unmap(host, host->data);
 		omap_free_dma(dma_ch);
 	}
 	host->data = NULL;
@@ -1600,8 +1654,7 @@ static void omap_hsmmc_dma_cb(int lch, u16 ch_status, void *cb_data)
 		return;
 	}
 
-	dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
-		omap_hsmmc_get_dma_dir(host, data));
+	omap_hsmmc_dma_unmap(host, data);
 
 	req_in_progress = host->req_in_progress;
 	dma_ch = host->dma_ch;
@@ -1653,8 +1706,11 @@ static int omap_hsmmc_start_sdma_transfer(struct omap_hsmmc_host *host,
 		return ret;
 	}
 
-	host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
-			data->sg_len, omap_hsmmc_get_dma_dir(host, data));
+	ret = omap_hsmmc_pre_dma_transfer(host, data, NULL);
+	if (ret) {
+		omap_free_dma(dma_ch);
+		return ret;
+	}
 	host->dma_ch = dma_ch;
 	host->dma_sg_idx = 0;
 
@@ -1672,8 +1728,6 @@ static int mmc_populate_adma_desc_table(struct omap_hsmmc_host *host,
 	dma_addr_t dmaaddr;
 	struct mmc_data *data = req->data;
 
-	host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
-			data->sg_len, omap_hsmmc_get_dma_dir(host, data));
 	for (i = 0, j = 0; i < host->dma_len; i++) {
 		dmaaddr = sg_dma_address(data->sg + i);
 		dmalen = sg_dma_len(data->sg + i);
@@ -1792,6 +1846,9 @@ omap_hsmmc_prepare_data(struct omap_hsmmc_host *host, struct mmc_request *req)
 			return ret;
 		}
 	} else if (host->dma_type == ADMA_XFER) {
+		ret = omap_hsmmc_pre_dma_transfer(host, req->data, NULL);
+		if (ret)
+			return ret;
 		numblks = mmc_populate_adma_desc_table(host,
 				req, host->adma_table);
 		WARN_ON(numblks != req->data->blocks);
@@ -2377,10 +2434,46 @@ static int omap_hsmmc_disable_simple(struct mmc_host *mmc, int lazy)
 	return 0;
 }
 
+static void omap_hsmmc_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+				int err)
+{
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (data && data->host_cookie) {
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+			     omap_hsmmc_get_dma_dir(host, data));
+		data->host_cookie = 0;
+	}
+}
+
+/*
+ * Map the next request's buffers, including the cache maintenance that
+ * goes with it, while the current request is still transferring.
+ */
+static void omap_hsmmc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			       bool is_first_req)
+{
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+
+	if (!mrq->data)
+		return;
+
+	if (mrq->data->host_cookie) {
+		mrq->data->host_cookie = 0;
+		return;
+	}
+
+	if (omap_hsmmc_pre_dma_transfer(host, mrq->data, &host->next_data))
+		mrq->data->host_cookie = 0;
+}
+
 static const struct mmc_host_ops omap_hsmmc_ops = {
 	.enable = omap_hsmmc_enable_simple,
 	.disable = omap_hsmmc_disable_simple,
 	.request = omap_hsmmc_request,
+	.pre_req = omap_hsmmc_pre_req,
+	.post_req = omap_hsmmc_post_req,
 	.set_ios = omap_hsmmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
 	.get_ro = omap_hsmmc_get_ro,
@@ -2392,6 +2485,8 @@ static const struct mmc_host_ops omap_hsmmc_ps_ops = {
 	.enable = omap_hsmmc_enable,
 	.disable = omap_hsmmc_disable,
 	.request = omap_hsmmc_request,
+	.pre_req = omap_hsmmc_pre_req,
+	.post_req = omap_hsmmc_post_req,
 	.set_ios = omap_hsmmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
 	.get_ro = omap_hsmmc_get_ro,
@@ -25,6 +25,8 @@
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
@@ -33,17 +35,22 @@
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.
+ *
+ * Offsets into the log are logical: they only ever grow and logger_offset()
+ * maps them into the buffer. Entries between
+ * 'head' and 'w_off' are intact. Writers reserve space for an entry under
+ * 'lock', but copy the payload without it, so several writers fill in their
+ * entries in parallel. An entry whose hdr_size is still zero is being written
+ * and ends what readers can see.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
-	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
-	size_t			head;	/* new readers start here */
+	spinlock_t		lock;	/* protects w_off and head */
+	u64			w_off;	/* end of the last reserved entry */
+	u64			head;	/* oldest entry, new readers start here */
 	size_t			size;	/* size of the log */
 };
 
@@ -51,19 +58,24 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. The structure is protected by the mutex 'mutex'.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
-	struct list_head	list;	/* entry in logger_log's list */
-	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* serializes reads on this file */
+	unsigned char		*buf;	/* payload of the entry being read */
+	u64			r_off;	/* current read head offset */
 	bool			r_all;	/* reader can read all entries */
+	bool			r_batch; /* read() returns as many entries as fit */
 	int			r_ver;	/* reader ABI version */
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
+/* logger_before - is logical offset 'a' before 'b'? */
+#define logger_before(a, b)	((s64)((a) - (b)) < 0)
+
 /*
  * file_get_log - Given a file structure, return the associated log
  *
@@ -97,7 +109,10 @@ static inline struct logger_log *file_get_log(struct file *file)
 static struct logger_entry *get_entry_header(struct logger_log *log,
 		size_t off, struct logger_entry *scratch)
 {
-	size_t len = min(sizeof(struct logger_entry), log->size - off);
+	size_t len;
+
+	off = logger_offset(off);
+	len = min(sizeof(struct logger_entry), log->size - off);
 	if (len != sizeof(struct logger_entry)) {
 		memcpy(((void *) scratch), log->buffer + off, len);
 		memcpy(((void *) scratch) + len, log->buffer,
@@ -108,21 +123,6 @@ static struct logger_entry *get_entry_header(struct logger_log *log,
 	return (struct logger_entry *) (log->buffer + off);
 }
 
-/*
- * get_entry_msg_len - Grabs the length of the message of the entry
- * starting from from 'off'.
- *
- * Caller needs to hold log->mutex.
- */
-static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
-{
-	struct logger_entry scratch;
-	struct logger_entry *entry;
-
-	entry = get_entry_header(log, off, &scratch);
-	return entry->len;
-}
-
 static size_t get_user_hdr_len(int ver)
 {
 	if (ver < 2)
@@ -156,78 +156,105 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * do_read_log - copies 'count' bytes at offset 'off' of 'log' into 'buf'
+ */
+static void do_read_log(struct logger_log *log, size_t off, void *buf,
+			size_t count)
+{
+	size_t len;
+
+	off = logger_offset(off);
+	len = min(count, log->size - off);
+	memcpy(buf, log->buffer + off, len);
+
+	if (count != len)
+		memcpy(buf + len, log->buffer, count - len);
+}
+
+/*
+ * logger_peek - finds the next entry 'reader' can read, skipping those of
+ * other users and discarded ones, and copies its header into 'hdr'.
  *
- * Caller must hold log->mutex.
+ * Returns 1 if there is such an entry, 0 if the reader has caught up with
+ * the committed entries. Caller needs to hold reader->mutex.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static int logger_peek(struct logger_log *log, struct logger_reader *reader,
+		       struct logger_entry *hdr)
 {
 	struct logger_entry scratch;
 	struct logger_entry *entry;
-	size_t len;
-	size_t msg_start;
+	int ret = 0;
 
-	/*
-	 * First, copy the header to userspace, using the version of
-	 * the header requested
-	 */
-	entry = get_entry_header(log, reader->r_off, &scratch);
-	if (copy_header_to_user(reader->r_ver, entry, buf))
-		return -EFAULT;
+	spin_lock(&log->lock);
 
-	count -= get_user_hdr_len(reader->r_ver);
-	buf += get_user_hdr_len(reader->r_ver);
-	msg_start = logger_offset(reader->r_off + sizeof(struct logger_entry));
+	/* pull forward a reader lapped by the writers */
+	if (logger_before(reader->r_off, log->head))
+		reader->r_off = log->head;
 
-	/*
-	 * We read from the msg in two disjoint operations. First, we read from
-	 * the current msg head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
-	 */
-	len = min(count, log->size - msg_start);
-	if (copy_to_user(buf, log->buffer + msg_start, len))
-		return -EFAULT;
+	while (logger_before(reader->r_off, log->w_off)) {
+		entry = get_entry_header(log, reader->r_off, &scratch);
+		if (!entry->hdr_size)
+			break;
 
-	/*
-	 * Second, we read any remaining bytes, starting back at the head of
-	 * the log.
-	 */
-	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+		/* LOGGER_SET_POSITION was not given an entry boundary */
+		if (unlikely(entry->len > LOGGER_ENTRY_MAX_PAYLOAD)) {
+			reader->r_off = log->w_off;
+			break;
+		}
+
+		if (entry->hdr_size != LOGGER_ENTRY_DISCARDED &&
+		    (reader->r_all || entry->euid == current_euid())) {
+			*hdr = *entry;
+			ret = 1;
+			break;
+		}
+
+		reader->r_off += sizeof(struct logger_entry) + entry->len;
+	}
+
+	if (unlikely(logger_before(log->w_off, reader->r_off)))
+		reader->r_off = log->w_off;
 
-	reader->r_off = logger_offset(reader->r_off +
-		sizeof(struct logger_entry) + count);
+	spin_unlock(&log->lock);
 
-	return count + get_user_hdr_len(reader->r_ver);
+	return ret;
 }
 
 /*
- * get_next_entry_by_uid - Starting at 'off', returns an offset into
- * 'log->buffer' which contains the first entry readable by 'euid'
+ * logger_read_entry - copies the entry at the reader's offset, whose header
+ * logger_peek() returned in 'hdr', to the user-space buffer 'buf' and moves
+ * the reader past it.
+ *
+ * Returns the number of bytes copied, -EAGAIN if writers overwrote the entry
+ * while it was being read or -EFAULT. Caller needs to hold reader->mutex.
  */
-static size_t get_next_entry_by_uid(struct logger_log *log,
-		size_t off, uid_t euid)
+static ssize_t logger_read_entry(struct logger_log *log,
+				 struct logger_reader *reader,
+				 struct logger_entry *hdr, char __user *buf)
 {
-	while (off != log->w_off) {
-		struct logger_entry *entry;
-		struct logger_entry scratch;
-		size_t next_len;
+	size_t hdr_len = get_user_hdr_len(reader->r_ver);
+	bool lapped;
 
-		entry = get_entry_header(log, off, &scratch);
+	/*
+	 * Copy the payload out without holding log->lock, then make sure no
+	 * writer lapped us and overwrote it in the meantime.
+	 */
+	do_read_log(log, reader->r_off + sizeof(struct logger_entry),
+		    reader->buf, hdr->len);
 
-		if (entry->euid == euid)
-			return off;
+	spin_lock(&log->lock);
+	lapped = logger_before(reader->r_off, log->head);
+	spin_unlock(&log->lock);
+	if (unlikely(lapped))
+		return -EAGAIN;
 
-		next_len = sizeof(struct logger_entry) + entry->len;
-		off = logger_offset(off + next_len);
-	}
+	if (copy_header_to_user(reader->r_ver, hdr, buf) ||
+	    copy_to_user(buf + hdr_len, reader->buf, hdr->len))
+		return -EFAULT;
 
-	return off;
+	reader->r_off += sizeof(struct logger_entry) + hdr->len;
+
+	return hdr_len + hdr->len;
 }
 
 /*
@@ -237,7 +264,8 @@ static size_t get_next_entry_by_uid(struct logger_log *log,
  *
  * 	- O_NONBLOCK works
  * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * 	- Atomically reads exactly one log entry, or in batch mode as many
+ * 	  whole entries as fit in the buffer
  *
  * Will set errno to EINVAL if read
  * buffer is insufficient to hold next entry.
@@ -247,18 +275,21 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
-	ssize_t ret;
+	struct logger_entry hdr;
+	size_t hdr_len = get_user_hdr_len(reader->r_ver);
+	ssize_t ret, nr;
 	DEFINE_WAIT(wait);
 
 start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
-		if (!ret)
+		mutex_lock(&reader->mutex);
+		if (logger_peek(log, reader, &hdr)) {
+			ret = 0;
 			break;
+		}
+		mutex_unlock(&reader->mutex);
 
 		if (file->f_flags & O_NONBLOCK) {
 			ret = -EAGAIN;
@@ -277,139 +308,130 @@ start:
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
-
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
-
-	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
-		goto start;
-	}
-
-	/* get the size of the next entry */
-	ret = get_user_hdr_len(reader->r_ver) +
-		get_entry_msg_len(log, reader->r_off);
+	/* reader->mutex is held from here on */
+	ret = hdr_len + hdr.len;
 	if (count < ret) {
 		ret = -EINVAL;
 		goto out;
 	}
 
 	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
-
-out:
-	mutex_unlock(&log->mutex);
-
-	return ret;
-}
-
-/*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
- *
- * Caller must hold log->mutex.
- */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
-{
-	size_t count = 0;
-
-	do {
-		size_t nr = sizeof(struct logger_entry) +
-			get_entry_msg_len(log, off);
-		off = logger_offset(off + nr);
-		count += nr;
-	} while (count < len);
-
-	return off;
-}
-
-/*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
- */
-static inline int clock_interval(size_t a, size_t b, size_t c)
-{
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
+	ret = logger_read_entry(log, reader, &hdr, buf);
+	if (unlikely(ret == -EAGAIN)) {
+		mutex_unlock(&reader->mutex);
+		goto start;
 	}
+	if (ret < 0)
+		goto out;
 
-	return 0;
-}
+	/* in batch mode, fill the rest of the buffer with whole entries */
+	while (reader->r_batch && logger_peek(log, reader, &hdr)) {
+		if (hdr_len + hdr.len > count - ret)
+			break;
 
-/*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
- *
- * The caller needs to hold log->mutex.
- */
-static void fix_up_readers(struct logger_log *log, size_t len)
-{
-	size_t old = log->w_off;
-	size_t new = logger_offset(old + len);
-	struct logger_reader *reader;
+		nr = logger_read_entry(log, reader, &hdr, buf + ret);
+		if (nr == -EAGAIN)
+			continue;
+		if (nr < 0)
+			break;
+		ret += nr;
+	}
 
-	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
+out:
+	mutex_unlock(&reader->mutex);
 
-	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+	return ret;
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
- *
- * The caller needs to hold log->mutex.
+ * do_write_log - writes 'count' bytes from 'buf' to 'log' at offset 'off'
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, size_t off, const void *buf,
+			 size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	off = logger_offset(off);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
+ * do_write_log_user - writes 'count' bytes from the user-space buffer 'buf'
+ * to the log 'log' at offset 'off'
  *
  * Returns 'count' on success, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t off,
 				      const void __user *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	off = logger_offset(off);
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
-
 	return count;
 }
 
+/*
+ * logger_reserve - reserves room for an entry with header 'header' at the
+ * write head and writes the header there, marked as not yet committed.
+ * Entries which the new one overwrites are dropped from the log. If one of
+ * them is still being written, which takes a writer stalled for a whole lap
+ * of the log, we wait for it rather than overwrite it.
+ *
+ * Returns the offset of the new entry.
+ */
+static u64 logger_reserve(struct logger_log *log, struct logger_entry *header)
+{
+	size_t len = sizeof(struct logger_entry) + header->len;
+	struct logger_entry scratch;
+	struct logger_entry *entry;
+	u64 off;
+
+	header->hdr_size = 0;
+
+	spin_lock(&log->lock);
+	while (log->w_off + len - log->head > log->size) {
+		entry = get_entry_header(log, log->head, &scratch);
+		if (unlikely(!entry->hdr_size)) {
+			spin_unlock(&log->lock);
+			schedule_timeout_uninterruptible(1);
+			spin_lock(&log->lock);
+			continue;
+		}
+		log->head += sizeof(struct logger_entry) + entry->len;
+	}
+	off = log->w_off;
+	log->w_off += len;
+	do_write_log(log, off, header, sizeof(struct logger_entry));
+	spin_unlock(&log->lock);
+
+	return off;
+}
+
+/*
+ * logger_commit - makes the entry at 'off' visible to readers by setting its
+ * hdr_size.
+ */
+static void logger_commit(struct logger_log *log, u64 off, __u16 hdr_size)
+{
+	/* log->lock also orders the payload before hdr_size for readers */
+	spin_lock(&log->lock);
+	do_write_log(log, off + offsetof(struct logger_entry, hdr_size),
+		     &hdr_size, sizeof(hdr_size));
+	spin_unlock(&log->lock);
+}
+
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
@@ -419,9 +441,9 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
+	u64 off;
 	ssize_t ret = 0;
 
 	now = current_kernel_time();
@@ -432,23 +454,12 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	header.nsec = now.tv_nsec;
 	header.euid = current_euid();
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
-	header.hdr_size = sizeof(struct logger_entry);
 
 	/* null writes succeed, return zero */
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
-	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
-	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
-
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	off = logger_reserve(log, &header);
 
 	while (nr_segs-- > 0) {
 		size_t len;
@@ -458,10 +469,14 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log,
+			off + sizeof(struct logger_entry) + ret,
+			iov->iov_base, len);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
+			/* the space is taken, tell readers to skip it */
+			logger_commit(log, off, LOGGER_ENTRY_DISCARDED);
+			/* a reader may be blocked waiting on this entry */
+			wake_up_interruptible(&log->wq);
 			return nr;
 		}
 
@@ -469,7 +484,7 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		ret += nr;
 	}
 
-	mutex_unlock(&log->mutex);
+	logger_commit(log, off, sizeof(struct logger_entry));
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
@@ -504,17 +519,22 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->buf = kmalloc(LOGGER_ENTRY_MAX_PAYLOAD, GFP_KERNEL);
+		if (!reader->buf) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
 		reader->r_ver = 1;
+		reader->r_batch = false;
 		reader->r_all = in_egroup_p(inode->i_gid) ||
 			capable(CAP_SYSLOG);
+		mutex_init(&reader->mutex);
 
-		INIT_LIST_HEAD(&reader->list);
-
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
-		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -532,7 +552,7 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
-		list_del(&reader->list);
+		kfree(reader->buf);
 		kfree(reader);
 	}
 
@@ -552,6 +572,7 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 {
 	struct logger_reader *reader;
 	struct logger_log *log;
+	struct logger_entry hdr;
 	unsigned int ret = POLLOUT | POLLWRNORM;
 
 	if (!(file->f_mode & FMODE_READ))
@@ -562,14 +583,10 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
-
-	if (log->w_off != reader->r_off)
+	mutex_lock(&reader->mutex);
+	if (logger_peek(log, reader, &hdr))
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -587,15 +604,58 @@ static long logger_set_version(struct logger_reader *reader, void __user *arg)
 	return 0;
 }
 
+static long logger_get_position(struct logger_log *log,
+				struct logger_reader *reader, void __user *arg)
+{
+	struct logger_position pos;
+
+	spin_lock(&log->lock);
+	pos.start = log->head;
+	pos.end = log->w_off;
+	pos.read = reader->r_off;
+	spin_unlock(&log->lock);
+
+	if (copy_to_user(arg, &pos, sizeof(pos)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/*
+ * logger_set_position - moves the reader to the entry at offset '*arg', for
+ * readers which consumed the log through mmap() and want poll() and read()
+ * to carry on from there.
+ */
+static long logger_set_position(struct logger_log *log,
+				struct logger_reader *reader, void __user *arg)
+{
+	__u64 off;
+	long ret = 0;
+
+	if (!reader->r_all)
+		return -EPERM;
+
+	if (copy_from_user(&off, arg, sizeof(off)))
+		return -EFAULT;
+
+	spin_lock(&log->lock);
+	if (logger_before(log->w_off, off))
+		ret = -EINVAL;
+	else
+		reader->r_off = off;
+	spin_unlock(&log->lock);
+
+	return ret;
+}
+
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
 	struct logger_reader *reader;
+	struct logger_entry hdr;
 	long ret = -EINVAL;
 	void __user *argp = (void __user *) arg;
 
-	mutex_lock(&log->mutex);
-
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
 		ret = log->size;
@@ -606,10 +666,14 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
+		mutex_lock(&reader->mutex);
+		spin_lock(&log->lock);
+		if (logger_before(reader->r_off, log->head))
+			ret = log->w_off - log->head;
 		else
-			ret = (log->size - reader->r_off) + log->w_off;
+			ret = log->w_off - reader->r_off;
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -618,24 +682,33 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		}
 		reader = file->private_data;
 
-		if (!reader->r_all)
-			reader->r_off = get_next_entry_by_uid(log,
-				reader->r_off, current_euid());
-
-		if (log->w_off != reader->r_off)
-			ret = get_user_hdr_len(reader->r_ver) +
-				get_entry_msg_len(log, reader->r_off);
+		mutex_lock(&reader->mutex);
+		if (logger_peek(log, reader, &hdr))
+			ret = get_user_hdr_len(reader->r_ver) + hdr.len;
 		else
 			ret = 0;
+		mutex_unlock(&reader->mutex);
 		break;
 	case LOGGER_FLUSH_LOG:
 		if (!(file->f_mode & FMODE_WRITE)) {
 			ret = -EBADF;
 			break;
 		}
-		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+		/*
+		 * Readers behind the head catch up on their next read. Stop
+		 * at an entry still being written, it must not be reused.
+		 */
+		spin_lock(&log->lock);
+		while (log->head != log->w_off) {
+			struct logger_entry scratch;
+			struct logger_entry *entry;
+
+			entry = get_entry_header(log, log->head, &scratch);
+			if (!entry->hdr_size)
+				break;
+			log->head += sizeof(struct logger_entry) + entry->len;
+		}
+		spin_unlock(&log->lock);
 		ret = 0;
 		break;
 	case LOGGER_GET_VERSION:
@@ -652,18 +725,74 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
+		mutex_lock(&reader->mutex);
 		ret = logger_set_version(reader, argp);
+		mutex_unlock(&reader->mutex);
+		break;
+	case LOGGER_SET_BATCH:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		mutex_lock(&reader->mutex);
+		reader->r_batch = !!arg;
+		mutex_unlock(&reader->mutex);
+		ret = 0;
+		break;
+	case LOGGER_GET_POSITION:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		mutex_lock(&reader->mutex);
+		ret = logger_get_position(log, reader, argp);
+		mutex_unlock(&reader->mutex);
+		break;
+	case LOGGER_SET_POSITION:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		mutex_lock(&reader->mutex);
+		ret = logger_set_position(log, reader, argp);
+		mutex_unlock(&reader->mutex);
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
-
 	return ret;
 }
 
+/*
+ * logger_mmap - the log's mmap file operation
+ *
+ * Maps the whole ring buffer read-only, for readers allowed to read every
+ * entry. See logger.h for how to walk it.
+ */
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_reader *reader = file->private_data;
+	struct logger_log *log = reader->log;
+
+	if (!reader->r_all)
+		return -EPERM;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != log->size)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return remap_vmalloc_range(vma, log->buffer, 0);
+}
+
 static const struct file_operations logger_fops = {
 	.owner = THIS_MODULE,
 	.read = logger_read,
+	.mmap = logger_mmap,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
 	.unlocked_ioctl = logger_ioctl,
@@ -674,13 +803,12 @@ static const struct file_operations logger_fops = {
 
 /*
  * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, and greater than
- * (LOGGER_ENTRY_MAX_PAYLOAD + sizeof(struct logger_entry)).
+ * must be a power of two, at least a page, and greater than
+ * (LOGGER_ENTRY_MAX_PAYLOAD + sizeof(struct logger_entry)). The buffer is
+ * allocated by init_log().
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
 static struct logger_log VAR = { \
-	.buffer = _buf_ ## VAR, \
 	.misc = { \
 		.minor = MISC_DYNAMIC_MINOR, \
 		.name = NAME, \
@@ -688,8 +816,7 @@ static struct logger_log VAR = { \
 		.parent = NULL, \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
-	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
@@ -717,10 +844,20 @@ static int __init init_log(struct logger_log *log)
 {
 	int ret;
 
+	/* vmalloc_user() memory can be mapped by logger_mmap() */
+	log->buffer = vmalloc_user(log->size);
+	if (unlikely(!log->buffer)) {
+		printk(KERN_ERR "logger: failed to allocate buffer "
+		       "for log '%s'!\n", log->misc.name);
+		return -ENOMEM;
+	}
+
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
 		printk(KERN_ERR "logger: failed to register misc "
 		       "device for log '%s'!\n", log->misc.name);
+		vfree(log->buffer);
+		log->buffer = NULL;
 		return ret;
 	}
 
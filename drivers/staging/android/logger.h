@@ -58,6 +58,32 @@ struct logger_entry {
 
 #define LOGGER_ENTRY_MAX_PAYLOAD	4076
 
+/*
+ * Readers allowed to read every entry can mmap() the whole log read-only.
+ * Entries are laid out back to back as a struct logger_entry followed by
+ * 'len' bytes of payload, and may wrap around the end of the buffer.
+ * Offsets are logical and only grow; an entry at offset 'off' starts at byte
+ * (off & (size - 1)) of the mapping, where size is LOGGER_GET_LOG_BUF_SIZE.
+ *
+ * LOGGER_GET_POSITION returns the offsets of the oldest entry and of the end
+ * of the log. Walk the entries from there, stopping at the end or at an
+ * entry whose hdr_size is 0, which is still being written. Skip entries whose
+ * hdr_size is LOGGER_ENTRY_DISCARDED. Writers overwrite the oldest entries,
+ * so once an entry has been copied out, check with LOGGER_GET_POSITION that
+ * its offset is not before the start of the log any more; if it is, the copy
+ * may be torn and the walk has to restart from the new start.
+ *
+ * LOGGER_SET_POSITION tells the kernel where such a reader got to, so that
+ * poll() only reports entries after it.
+ */
+#define LOGGER_ENTRY_DISCARDED	0xffff
+
+struct logger_position {
+	__u64		start;	/* offset of the oldest entry */
+	__u64		end;	/* offset just past the newest entry */
+	__u64		read;	/* offset of this reader's next entry */
+};
+
 #define __LOGGERIO	0xAE
 
 #define LOGGER_GET_LOG_BUF_SIZE		_IO(__LOGGERIO, 1) /* size of log */
@@ -66,5 +92,8 @@ struct logger_entry {
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
 #define LOGGER_GET_VERSION		_IO(__LOGGERIO, 5) /* abi version */
 #define LOGGER_SET_VERSION		_IO(__LOGGERIO, 6) /* abi version */
+#define LOGGER_SET_BATCH		_IO(__LOGGERIO, 7) /* multi-entry reads */
+#define LOGGER_GET_POSITION		_IOR(__LOGGERIO, 8, struct logger_position)
+#define LOGGER_SET_POSITION		_IOW(__LOGGERIO, 9, __u64)
 
 #endif /* _LINUX_LOGGER_H */
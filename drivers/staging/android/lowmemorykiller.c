@@ -16,6 +16,24 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * The number of shrink callbacks, the number that had to look for a
+ * process to kill and the total time spent looking (in nanoseconds) are
+ * exported read-only as the calls, scans and scan_time_ns parameters.
+ *
+ * The driver also tracks memory pressure, from 0 to 100, over windows of
+ * pressure_window_ms milliseconds. It is derived from the share of pages
+ * vmscan scanned without reclaiming them, the share of time allocating tasks
+ * spent stalled in direct reclaim and how full swap (normally zram) is.
+ * Writing 1 to the pressure_mode parameter scales the minfree thresholds
+ * with it, from half their value when reclaim is easy to twice their value
+ * when it fails. /dev/lowmemorykiller reports the pressure as a line of text:
+ *
+ *   <level> <pressure> <scanned> <reclaimed> <stall_us> <swap_fill> <kills>
+ *
+ * where level is one of low, medium or critical and the counts are for the
+ * last window. The device polls readable whenever the level changes or a
+ * process is killed. Like a sysfs attribute, it is read again from offset 0.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -35,6 +53,16 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+#include <linux/workqueue.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -55,6 +83,65 @@ static int lowmem_minfree_size = 4;
 static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
 
+/*
+ * Thread group leaders that may be killed, bucketed by oom_adj, so that
+ * lowmem_shrink() only looks at the tasks it would actually pick from
+ * instead of walking every process. The index follows the process list
+ * and is protected by tasklist_lock. Processes forked before lowmem_init()
+ * are added there.
+ */
+#define LOWMEM_ADJ_BUCKETS	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+static struct list_head lowmem_tasks[LOWMEM_ADJ_BUCKETS];
+static bool lowmem_index_ready;
+
+/* Statistics */
+static atomic64_t lowmem_calls;		/* all shrink callbacks */
+static atomic64_t lowmem_scans;		/* callbacks that looked for a victim */
+static atomic64_t lowmem_scan_ns;	/* total time spent looking */
+
+enum lowmem_level {
+	LOWMEM_LEVEL_LOW,
+	LOWMEM_LEVEL_MEDIUM,
+	LOWMEM_LEVEL_CRITICAL,
+};
+
+static const char * const lowmem_level_names[] = {
+	"low", "medium", "critical"
+};
+
+#define LOWMEM_PRESSURE_MEDIUM		60
+#define LOWMEM_PRESSURE_CRITICAL	95
+
+struct lowmem_pressure {
+	/* Totals at the start of the current window */
+	unsigned long scanned_total;
+	unsigned long reclaimed_total;
+	unsigned long stall_us_total;
+	unsigned long start;			/* jiffies */
+
+	/* Results for the last complete window */
+	unsigned long scanned;
+	unsigned long reclaimed;
+	unsigned long stall_us;
+	int swap_fill;				/* percent */
+	int pressure;
+	enum lowmem_level level;
+
+	atomic_t kills;
+	atomic_t seq;				/* bumped on every event */
+};
+
+static uint32_t lowmem_pressure_mode;
+static uint32_t lowmem_pressure_window_ms = 100;
+static struct lowmem_pressure lowmem_pressure;
+static DEFINE_MUTEX(lowmem_pressure_lock);
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_pressure_wait);
+static unsigned long lowmem_vm_events[NR_VM_EVENT_ITEMS];
+
+static void lowmem_pressure_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(lowmem_pressure_work, lowmem_pressure_fn);
+
 #define lowmem_print(level, x...)			\
 	do {						\
 		if (lowmem_debug_level >= (level))	\
@@ -79,6 +166,189 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 	return NOTIFY_OK;
 }
 
+static struct list_head *lowmem_bucket(int oom_adj)
+{
+	oom_adj = clamp(oom_adj, OOM_DISABLE, OOM_ADJUST_MAX);
+	return &lowmem_tasks[oom_adj - OOM_DISABLE];
+}
+
+static void __lowmem_task_add(struct task_struct *p)
+{
+	/* Kernel threads have nothing for us to free */
+	if (!p->mm)
+		return;
+	list_add_tail(&p->lowmem_node, lowmem_bucket(p->signal->oom_adj));
+}
+
+void lowmem_task_add(struct task_struct *p)
+{
+	INIT_LIST_HEAD(&p->lowmem_node);
+	if (lowmem_index_ready)
+		__lowmem_task_add(p);
+}
+
+void lowmem_task_del(struct task_struct *p)
+{
+	list_del_init(&p->lowmem_node);
+}
+
+/* de_thread() made new the thread group leader in place of old */
+void lowmem_task_replace(struct task_struct *old, struct task_struct *new)
+{
+	if (list_empty(&old->lowmem_node))
+		INIT_LIST_HEAD(&new->lowmem_node);
+	else
+		list_replace_init(&old->lowmem_node, &new->lowmem_node);
+}
+
+/*
+ * p gained an mm through exec. Tasks that had none at fork, such as
+ * usermodehelper children, are only indexed from here. Only current
+ * adds itself to an empty node, so the unlocked check is safe.
+ */
+void lowmem_task_exec(struct task_struct *p)
+{
+	if (!list_empty(&p->lowmem_node))
+		return;
+
+	write_lock_irq(&tasklist_lock);
+	if (lowmem_index_ready && thread_group_leader(p) &&
+	    list_empty(&p->lowmem_node))
+		__lowmem_task_add(p);
+	write_unlock_irq(&tasklist_lock);
+}
+
+/* Called after p's oom_adj or oom_score_adj has been written */
+void lowmem_task_adj_changed(struct task_struct *p)
+{
+	struct task_struct *leader;
+
+	write_lock_irq(&tasklist_lock);
+	leader = p->group_leader;
+	/* Not indexed, or already unhashed */
+	if (!list_empty(&leader->lowmem_node))
+		list_move_tail(&leader->lowmem_node,
+			       lowmem_bucket(leader->signal->oom_adj));
+	write_unlock_irq(&tasklist_lock);
+}
+
+/* Sum the per-zone counters of a vm event starting at first */
+static unsigned long lowmem_zone_events(int first)
+{
+	unsigned long sum = 0;
+	int i;
+
+	for (i = 0; i < MAX_NR_ZONES; i++)
+		sum += lowmem_vm_events[first + i];
+
+	return sum;
+}
+
+static void lowmem_pressure_event(struct lowmem_pressure *lp)
+{
+	atomic_inc(&lp->seq);
+	wake_up_interruptible(&lowmem_pressure_wait);
+}
+
+/*
+ * Close the current window if it has run its course. Called with
+ * lowmem_pressure_lock held.
+ */
+static void lowmem_pressure_update(struct lowmem_pressure *lp)
+{
+	unsigned long window = msecs_to_jiffies(lowmem_pressure_window_ms);
+	unsigned long scanned, reclaimed, stall_us, window_us;
+	int pressure, stall;
+	enum lowmem_level level;
+
+	if (!window)
+		window = 1;
+	if (time_before(jiffies, lp->start + window))
+		return;
+
+	all_vm_events(lowmem_vm_events);
+	scanned = lowmem_zone_events(PGSCAN_KSWAPD_NORMAL - ZONE_NORMAL) +
+		  lowmem_zone_events(PGSCAN_DIRECT_NORMAL - ZONE_NORMAL);
+	reclaimed = lowmem_zone_events(PGSTEAL_NORMAL - ZONE_NORMAL);
+	stall_us = lowmem_vm_events[ALLOCSTALL_US];
+
+	lp->scanned = scanned - lp->scanned_total;
+	lp->reclaimed = reclaimed - lp->reclaimed_total;
+	lp->stall_us = stall_us - lp->stall_us_total;
+	window_us = jiffies_to_usecs(jiffies - lp->start);
+
+	lp->scanned_total = scanned;
+	lp->reclaimed_total = reclaimed;
+	lp->stall_us_total = stall_us;
+	lp->start = jiffies;
+
+	/* Too few pages scanned to say anything about efficiency */
+	pressure = 0;
+	if (lp->scanned >= SWAP_CLUSTER_MAX) {
+		reclaimed = min(lp->reclaimed, lp->scanned);
+		pressure = 100 - reclaimed * 100 / lp->scanned;
+	}
+
+	stall = 100;
+	if (window_us)
+		stall = min_t(u64, 100, div_u64((u64)lp->stall_us * 100,
+				window_us * num_online_cpus()));
+	pressure = max(pressure, stall);
+
+	/*
+	 * Anonymous memory cannot be reclaimed once swap is full, so a
+	 * full swap device raises the pressure half way to critical.
+	 */
+	lp->swap_fill = 0;
+	if (total_swap_pages > 0)
+		lp->swap_fill = (total_swap_pages - nr_swap_pages) * 100 /
+				total_swap_pages;
+	pressure += (100 - pressure) * lp->swap_fill / 200;
+	lp->pressure = pressure;
+
+	if (pressure >= LOWMEM_PRESSURE_CRITICAL)
+		level = LOWMEM_LEVEL_CRITICAL;
+	else if (pressure >= LOWMEM_PRESSURE_MEDIUM)
+		level = LOWMEM_LEVEL_MEDIUM;
+	else
+		level = LOWMEM_LEVEL_LOW;
+
+	if (level != lp->level) {
+		lowmem_print(3, "pressure %d, level %s\n", pressure,
+			     lowmem_level_names[level]);
+		lp->level = level;
+		lowmem_pressure_event(lp);
+	}
+
+	/* Reclaim may stop calling us; keep sampling until things settle */
+	if (level != LOWMEM_LEVEL_LOW)
+		schedule_delayed_work(&lowmem_pressure_work, window);
+}
+
+static void lowmem_pressure_fn(struct work_struct *work)
+{
+	mutex_lock(&lowmem_pressure_lock);
+	lowmem_pressure_update(&lowmem_pressure);
+	mutex_unlock(&lowmem_pressure_lock);
+}
+
+/*
+ * Percentage to scale the minfree thresholds by: 50 with no pressure,
+ * 100 at a pressure of 33 and 200 at 100.
+ */
+static int lowmem_minfree_scale(void)
+{
+	/* Don't make reclaimers queue up behind each other */
+	if (mutex_trylock(&lowmem_pressure_lock)) {
+		lowmem_pressure_update(&lowmem_pressure);
+		mutex_unlock(&lowmem_pressure_lock);
+	}
+
+	if (!lowmem_pressure_mode)
+		return 100;
+	return 50 + ACCESS_ONCE(lowmem_pressure.pressure) * 3 / 2;
+}
+
 static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
 	struct task_struct *p;
@@ -86,13 +356,16 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int rem = 0;
 	int tasksize;
 	int i;
+	int adj;
 	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
-	int selected_oom_adj;
+	int selected_oom_adj = 0;
+	ktime_t start;
 	int array_size = ARRAY_SIZE(lowmem_adj);
 	int other_free = global_page_state(NR_FREE_PAGES);
 	int other_file = global_page_state(NR_FILE_PAGES) -
 						global_page_state(NR_SHMEM);
+	int scale;
 
 	/*
 	 * If we already have a death outstanding, then
@@ -101,6 +374,8 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	 * this pass.
 	 *
 	 */
+	atomic64_inc(&lowmem_calls);
+
 	if (lowmem_deathpending &&
 	    time_before_eq(jiffies, lowmem_deathpending_timeout))
 		return 0;
@@ -109,17 +384,19 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		array_size = lowmem_adj_size;
 	if (lowmem_minfree_size < array_size)
 		array_size = lowmem_minfree_size;
+	scale = lowmem_minfree_scale();
 	for (i = 0; i < array_size; i++) {
-		if (other_free < lowmem_minfree[i] &&
-		    other_file < lowmem_minfree[i]) {
+		size_t minfree = lowmem_minfree[i] * scale / 100;
+
+		if (other_free < minfree && other_file < minfree) {
 			min_adj = lowmem_adj[i];
 			break;
 		}
 	}
 	if (sc->nr_to_scan > 0)
-		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
-			     sc->nr_to_scan, sc->gfp_mask, other_free, other_file,
-			     min_adj);
+		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d, "
+			     "scale %d\n", sc->nr_to_scan, sc->gfp_mask,
+			     other_free, other_file, min_adj, scale);
 	rem = global_page_state(NR_ACTIVE_ANON) +
 		global_page_state(NR_ACTIVE_FILE) +
 		global_page_state(NR_INACTIVE_ANON) +
@@ -129,42 +406,38 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			     sc->nr_to_scan, sc->gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_adj = min_adj;
+	if (min_adj < OOM_DISABLE)
+		min_adj = OOM_DISABLE;
 
+	atomic64_inc(&lowmem_scans);
+	start = ktime_get();
+
+	/*
+	 * Pick the largest task with the highest oom_adj: walk the buckets
+	 * down from OOM_ADJUST_MAX and stop at the first one with a task
+	 * that still has memory.
+	 */
 	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
-
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
+	for (adj = OOM_ADJUST_MAX; adj >= min_adj && !selected; adj--) {
+		list_for_each_entry(p, lowmem_bucket(adj), lowmem_node) {
+			struct mm_struct *mm;
+
+			task_lock(p);
+			mm = p->mm;
+			if (!mm) {
+				task_unlock(p);
 				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
+			}
+			tasksize = get_mm_rss(mm);
+			task_unlock(p);
+			if (tasksize <= selected_tasksize)
 				continue;
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = adj;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, "
+				     "to kill\n", p->pid, p->comm, adj, tasksize);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
 	}
 	if (selected) {
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
@@ -174,20 +447,120 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		lowmem_deathpending_timeout = jiffies + HZ;
 		force_sig(SIGKILL, selected);
 		rem -= selected_tasksize;
+		atomic_inc(&lowmem_pressure.kills);
+		lowmem_pressure_event(&lowmem_pressure);
 	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
 	read_unlock(&tasklist_lock);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &lowmem_scan_ns);
 	return rem;
 }
 
+struct lowmem_reader {
+	unsigned long seq;		/* last event seen */
+};
+
+static int lowmem_pressure_open(struct inode *inode, struct file *file)
+{
+	struct lowmem_reader *reader;
+
+	reader = kmalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	reader->seq = atomic_read(&lowmem_pressure.seq);
+	file->private_data = reader;
+	return 0;
+}
+
+static int lowmem_pressure_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static ssize_t lowmem_pressure_read(struct file *file, char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct lowmem_reader *reader = file->private_data;
+	struct lowmem_pressure lp;
+	char line[128];
+	int len;
+
+	mutex_lock(&lowmem_pressure_lock);
+	reader->seq = atomic_read(&lowmem_pressure.seq);
+	lowmem_pressure_update(&lowmem_pressure);
+	lp = lowmem_pressure;
+	mutex_unlock(&lowmem_pressure_lock);
+
+	len = scnprintf(line, sizeof(line), "%s %d %lu %lu %lu %d %d\n",
+			lowmem_level_names[lp.level], lp.pressure, lp.scanned,
+			lp.reclaimed, lp.stall_us, lp.swap_fill,
+			atomic_read(&lp.kills));
+
+	return simple_read_from_buffer(buf, count, ppos, line, len);
+}
+
+static unsigned int lowmem_pressure_poll(struct file *file, poll_table *wait)
+{
+	struct lowmem_reader *reader = file->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(file, &lowmem_pressure_wait, wait);
+
+	if (reader->seq != atomic_read(&lowmem_pressure.seq))
+		mask |= POLLIN | POLLRDNORM;
+
+	return mask;
+}
+
+static const struct file_operations lowmem_pressure_fops = {
+	.owner = THIS_MODULE,
+	.open = lowmem_pressure_open,
+	.release = lowmem_pressure_release,
+	.read = lowmem_pressure_read,
+	.poll = lowmem_pressure_poll,
+	.llseek = default_llseek,
+};
+
+static struct miscdevice lowmem_pressure_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "lowmemorykiller",
+	.fops = &lowmem_pressure_fops,
+};
+
 static struct shrinker lowmem_shrinker = {
 	.shrink = lowmem_shrink,
 	.seeks = DEFAULT_SEEKS * 16
 };
 
+static void __init lowmem_index_init(void)
+{
+	struct task_struct *p;
+	int i;
+
+	for (i = 0; i < LOWMEM_ADJ_BUCKETS; i++)
+		INIT_LIST_HEAD(&lowmem_tasks[i]);
+
+	write_lock_irq(&tasklist_lock);
+	for_each_process(p)
+		__lowmem_task_add(p);
+	lowmem_index_ready = true;
+	write_unlock_irq(&tasklist_lock);
+}
+
 static int __init lowmem_init(void)
 {
+	int ret;
+
+	lowmem_index_init();
+	lowmem_pressure.start = jiffies;
+	ret = misc_register(&lowmem_pressure_dev);
+	if (ret)
+		pr_err("lowmemorykiller: failed to register misc device: %d\n",
+		       ret);
 	task_free_register(&task_nb);
 	register_shrinker(&lowmem_shrinker);
 	return 0;
@@ -197,14 +570,33 @@ static void __exit lowmem_exit(void)
 {
 	unregister_shrinker(&lowmem_shrinker);
 	task_free_unregister(&task_nb);
+	cancel_delayed_work_sync(&lowmem_pressure_work);
+	misc_deregister(&lowmem_pressure_dev);
+}
+
+static int lowmem_param_get_atomic64(char *buffer, const struct kernel_param *kp)
+{
+	return sprintf(buffer, "%lld", (long long)atomic64_read(kp->arg));
 }
 
+static struct kernel_param_ops lowmem_param_ops_atomic64 = {
+	.get = lowmem_param_get_atomic64,
+};
+
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
 module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 			 S_IRUGO | S_IWUSR);
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(pressure_mode, lowmem_pressure_mode, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(pressure_window_ms, lowmem_pressure_window_ms, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_cb(calls, &lowmem_param_ops_atomic64, &lowmem_calls, S_IRUGO);
+module_param_cb(scans, &lowmem_param_ops_atomic64, &lowmem_scans, S_IRUGO);
+module_param_cb(scan_time_ns, &lowmem_param_ops_atomic64, &lowmem_scan_ns,
+		S_IRUGO);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
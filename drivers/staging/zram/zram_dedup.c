@@ -0,0 +1,210 @@
+/*
+ * Compressed RAM block device
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+/*
+ * Content based deduplication of compressed pages.
+ *
+ * Every stored object is indexed by a checksum of its uncompressed
+ * contents. A write whose checksum matches an existing object is
+ * verified by decompressing that object and comparing it with the
+ * page. If they are identical, the write just takes a reference to
+ * the object and skips compression and allocation entirely.
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zram_drv.h"
+
+u32 zram_dedup_checksum(void *mem)
+{
+	return jhash2(mem, PAGE_SIZE / sizeof(u32), 0);
+}
+
+/* Called with zram->dedup_lock held */
+static void zram_dedup_insert(struct zram *zram, struct zram_entry *new)
+{
+	struct rb_node **p = &zram->dedup_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct zram_entry *entry;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct zram_entry, rb_node);
+		if (new->checksum < entry->checksum)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&new->rb_node, parent, p);
+	rb_insert_color(&new->rb_node, &zram->dedup_root);
+}
+
+/*
+ * Called with zram->dedup_lock held. Returns the first entry with
+ * checksum in tree order; any others follow it through rb_next().
+ */
+static struct zram_entry *zram_dedup_lookup(struct zram *zram, u32 checksum)
+{
+	struct rb_node *node = zram->dedup_root.rb_node;
+	struct zram_entry *entry, *found = NULL;
+
+	while (node) {
+		entry = rb_entry(node, struct zram_entry, rb_node);
+		if (checksum == entry->checksum) {
+			found = entry;
+			node = node->rb_left;
+		} else if (checksum < entry->checksum)
+			node = node->rb_left;
+		else
+			node = node->rb_right;
+	}
+
+	return found;
+}
+
+/* Called with zram->dedup_lock held */
+static struct zram_entry *zram_dedup_next(struct zram_entry *entry)
+{
+	struct rb_node *node = rb_next(&entry->rb_node);
+	struct zram_entry *next;
+
+	if (!node)
+		return NULL;
+	next = rb_entry(node, struct zram_entry, rb_node);
+	return next->checksum == entry->checksum ? next : NULL;
+}
+
+static int zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+				struct page *page, void *buf)
+{
+	int ret;
+	size_t clen = PAGE_SIZE;
+	unsigned char *cmem, *user_mem;
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	ret = zram->backend->decompress(cmem, entry->len, buf, &clen);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	if (unlikely(ret || clen != PAGE_SIZE))
+		return 0;
+
+	user_mem = kmap_atomic(page, KM_USER0);
+	ret = !memcmp(user_mem, buf, PAGE_SIZE);
+	kunmap_atomic(user_mem, KM_USER0);
+
+	return ret;
+}
+
+/**
+ * zram_dedup_find - look for a stored object identical to page
+ * @zram: device to search
+ * @page: page being written
+ * @checksum: zram_dedup_checksum() of page contents
+ * @buf: PAGE_SIZE scratch buffer used to verify a candidate
+ *
+ * Returns the matching entry with a reference taken, or NULL.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
+				u32 checksum, void *buf)
+{
+	struct zram_entry *entry, *next;
+
+	spin_lock(&zram->dedup_lock);
+	entry = zram_dedup_lookup(zram, checksum);
+	if (entry)
+		entry->refcount++;
+	spin_unlock(&zram->dedup_lock);
+
+	/*
+	 * Different pages can share a checksum, so try every entry that
+	 * has it. The reference keeps an entry, and so its place in the
+	 * tree, alive while we compare.
+	 */
+	while (entry) {
+		if (zram_dedup_match(zram, entry, page, buf))
+			return entry;
+
+		spin_lock(&zram->dedup_lock);
+		next = zram_dedup_next(entry);
+		if (next)
+			next->refcount++;
+		spin_unlock(&zram->dedup_lock);
+
+		zram_dedup_put(zram, entry);
+		entry = next;
+	}
+
+	return NULL;
+}
+
+/**
+ * zram_dedup_add - index a newly stored object
+ * @zram: device the object belongs to
+ * @handle: zsmalloc handle of the compressed page
+ * @len: compressed size
+ * @checksum: zram_dedup_checksum() of the uncompressed page
+ *
+ * Returns the new entry holding one reference, or NULL if no memory
+ * is available (the caller still owns handle in that case).
+ */
+struct zram_entry *zram_dedup_add(struct zram *zram, void *handle,
+				u16 len, u32 checksum)
+{
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->len = len;
+	entry->refcount = 1;
+	entry->handle = handle;
+
+	spin_lock(&zram->dedup_lock);
+	zram_dedup_insert(zram, entry);
+	spin_unlock(&zram->dedup_lock);
+
+	return entry;
+}
+
+/**
+ * zram_dedup_put - drop a reference to an entry
+ * @zram: device the entry belongs to
+ * @entry: entry to release
+ *
+ * Frees the object and the entry with the last reference. Returns 1
+ * if it did, 0 if the object is still shared.
+ */
+int zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	spin_lock(&zram->dedup_lock);
+	if (--entry->refcount) {
+		spin_unlock(&zram->dedup_lock);
+		return 0;
+	}
+	rb_erase(&entry->rb_node, &zram->dedup_root);
+	spin_unlock(&zram->dedup_lock);
+
+	zs_free(zram->mem_pool, entry->handle);
+	kfree(entry);
+
+	return 1;
+}
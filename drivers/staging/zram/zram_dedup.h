@@ -0,0 +1,66 @@
+/*
+ * Compressed RAM block device
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+#include <linux/rbtree.h>
+#include <linux/types.h>
+
+struct page;
+struct zram;
+
+/*
+ * With deduplication enabled, the table entry of a compressed page
+ * points to one of these rather than directly at the zsmalloc object,
+ * so that pages with identical contents share a single object.
+ */
+struct zram_entry {
+	struct rb_node rb_node;		/* in zram->dedup_root */
+	u32 checksum;			/* of the uncompressed page */
+	u16 len;			/* compressed size */
+	unsigned long refcount;		/* protected by zram->dedup_lock */
+	void *handle;
+};
+
+#ifdef CONFIG_ZRAM_DEDUP
+u32 zram_dedup_checksum(void *mem);
+struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
+				u32 checksum, void *buf);
+struct zram_entry *zram_dedup_add(struct zram *zram, void *handle,
+				u16 len, u32 checksum);
+int zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+#else
+static inline u32 zram_dedup_checksum(void *mem)
+{
+	return 0;
+}
+
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+				struct page *page, u32 checksum, void *buf)
+{
+	return NULL;
+}
+
+static inline struct zram_entry *zram_dedup_add(struct zram *zram,
+				void *handle, u16 len, u32 checksum)
+{
+	return NULL;
+}
+
+static inline int zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	return 0;
+}
+#endif
+
+#endif
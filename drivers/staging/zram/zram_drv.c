@@ -23,13 +23,16 @@
 #include <linux/kernel.h>
 #include <linux/bio.h>
 #include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/ktime.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/lz4.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -42,14 +45,31 @@ struct zram *devices;
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
+static const struct zram_backend zram_backends[] = {
+	{
+		.name		= "lzo",
+		.workmem_size	= LZO1X_MEM_COMPRESS,
+		.compress	= lzo1x_1_compress,
+		.decompress	= lzo1x_decompress_safe,
+	},
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+	{
+		.name		= "lz4",
+		.workmem_size	= LZ4_MEM_COMPRESS,
+		.compress	= lz4_compress,
+		.decompress	= lz4_decompress_unknownoutputsize,
+	},
+#endif
+};
+
+static void zram_stat_inc(atomic_t *v)
 {
-	*v = *v + 1;
+	atomic_inc(v);
 }
 
-static void zram_stat_dec(u32 *v)
+static void zram_stat_dec(atomic_t *v)
 {
-	*v = *v - 1;
+	atomic_dec(v);
 }
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
@@ -89,21 +109,146 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+/*
+ * The slot lock serializes I/O on a table entry against writeback and
+ * swap slot free notification. Flags must only change with it held.
+ */
+static void zram_slot_lock(struct zram *zram, u32 index)
+{
+	bit_spin_lock(ZRAM_LOCK, &zram->table[index].flags);
+}
+
+static void zram_slot_unlock(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_LOCK, &zram->table[index].flags);
+}
+
+/* Called with the slot lock held */
+static void zram_accessed(struct zram *zram, u32 index)
+{
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram->table[index].ac_time = jiffies;
+#endif
+}
+
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
+static void zram_free_strm(struct zram_strm *strm)
+{
+	kfree(strm->workmem);
+	free_pages((unsigned long)strm->buffer, 1);
+	kfree(strm);
+}
+
+static struct zram_strm *zram_alloc_strm(struct zram *zram)
+{
+	struct zram_strm *strm;
+
+	strm = kzalloc(sizeof(*strm), GFP_KERNEL);
+	if (!strm)
+		return NULL;
+
+	strm->workmem = kzalloc(zram->backend->workmem_size, GFP_KERNEL);
+	strm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (!strm->workmem || !strm->buffer) {
+		zram_free_strm(strm);
+		return NULL;
+	}
+
+	return strm;
+}
+
+static void zram_destroy_strms(struct zram *zram)
+{
+	struct zram_strm *strm, *tmp;
+
+	list_for_each_entry_safe(strm, tmp, &zram->idle_strm, list) {
+		list_del(&strm->list);
+		zram_free_strm(strm);
+	}
+}
+
+static int zram_create_strms(struct zram *zram)
+{
+	int i;
+
+	/*
+	 * Size the pool for every CPU that can come online, so that writers
+	 * on CPUs brought up later do not queue for a stream.
+	 */
+	for (i = 0; i < num_possible_cpus(); i++) {
+		struct zram_strm *strm = zram_alloc_strm(zram);
+
+		if (!strm) {
+			zram_destroy_strms(zram);
+			return -ENOMEM;
+		}
+		list_add(&strm->list, &zram->idle_strm);
+	}
+
+	return 0;
+}
+
+/*
+ * Get an idle compression stream, waiting for one if all of them
+ * are in use by other writers.
+ */
+static struct zram_strm *zram_get_strm(struct zram *zram)
+{
+	struct zram_strm *strm;
+	ktime_t start = ktime_set(0, 0);
+	int waited = 0;
+
+	while (1) {
+		spin_lock(&zram->strm_lock);
+		if (!list_empty(&zram->idle_strm)) {
+			strm = list_first_entry(&zram->idle_strm,
+					struct zram_strm, list);
+			list_del(&strm->list);
+			spin_unlock(&zram->strm_lock);
+			break;
+		}
+		spin_unlock(&zram->strm_lock);
+
+		if (!waited) {
+			start = ktime_get();
+			waited = 1;
+		}
+		wait_event(zram->strm_wait, !list_empty(&zram->idle_strm));
+	}
+
+	if (unlikely(waited)) {
+		zram_stat64_inc(zram, &zram->stats.strm_waits);
+		zram_stat64_add(zram, &zram->stats.strm_wait_ns,
+			ktime_to_ns(ktime_sub(ktime_get(), start)));
+	}
+
+	return strm;
+}
+
+static void zram_put_strm(struct zram *zram, struct zram_strm *strm)
+{
+	spin_lock(&zram->strm_lock);
+	list_add(&strm->list, &zram->idle_strm);
+	spin_unlock(&zram->strm_lock);
+
+	wake_up(&zram->strm_wait);
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -133,56 +278,183 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Block 0 of the backing device is never used, so that the table entry
+ * of a written back page is never 0.
+ */
+static unsigned long zram_alloc_block(struct zram *zram)
+{
+	unsigned long blk_idx = 1;
+
+retry:
+	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, blk_idx);
+	if (blk_idx >= zram->nr_pages)
+		return 0;
+
+	if (test_and_set_bit(blk_idx, zram->bitmap))
+		goto retry;
+
+	return blk_idx;
+}
+
+static void zram_free_block(struct zram *zram, unsigned long blk_idx)
+{
+	WARN_ON_ONCE(!test_and_clear_bit(blk_idx, zram->bitmap));
+}
+
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/* Synchronous single page I/O to the backing device */
+static int zram_bdev_rw(struct zram *zram, struct page *page,
+			unsigned long blk_idx, int rw)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct bio *bio;
+	int ret = 0;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = blk_idx * SECTORS_PER_PAGE;
+	bio->bi_bdev = zram->bdev;
+	bio->bi_end_io = zram_bdev_end_io;
+	bio->bi_private = &done;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	submit_bio(rw | REQ_SYNC, bio);
+	wait_for_completion(&done);
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		ret = -EIO;
+	bio_put(bio);
+
+	return ret;
+}
+
+static int zram_read_from_bdev(struct zram *zram, struct page *page,
+			unsigned long blk_idx)
+{
+	int ret;
+
+	ret = zram_bdev_rw(zram, page, blk_idx, READ);
+	if (unlikely(ret)) {
+		pr_err("Backing device read failed! err=%d, block=%lu\n",
+			ret, blk_idx);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return ret;
+	}
+
+	zram_stat64_inc(zram, &zram->stats.bd_reads);
+	flush_dcache_page(page);
+	return 0;
+}
+#endif
+
+/* Queue writeback of a page just stored uncompressed */
+static void zram_wb_kick_huge(struct zram *zram)
+{
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Batch up pages for a second rather than rescan per page */
+	if (zram->bdev && !ACCESS_ONCE(zram->wb_stop))
+		queue_delayed_work(system_long_wq, &zram->wb_huge_work, HZ);
+#endif
+}
+
+/* Returns the zsmalloc handle of a compressed page */
+static void *zram_get_handle(struct zram *zram, u32 index)
+{
+	void *handle = zram->table[index].handle;
+
+	if (zram_dedup_enabled(zram))
+		handle = ((struct zram_entry *)handle)->handle;
+
+	return handle;
+}
+
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
-	void *obj;
+	void *handle = zram->table[index].handle;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	/* Tell a writeback in progress that the page has changed */
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 
-	if (unlikely(!page)) {
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
 		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
+		 * No memory is allocated for same filled pages.
+		 * Simply clear same page flag.
 		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		if (zram->table[index].element)
+			zram_stat_dec(&zram->stats.pages_same);
+		else
 			zram_stat_dec(&zram->stats.pages_zero);
-		}
+		zram->table[index].element = 0;
 		return;
 	}
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_free_block(zram, zram->table[index].element);
+		zram->table[index].element = 0;
+		zram_stat_dec(&zram->stats.pages_wb);
+		zram_stat_dec(&zram->stats.pages_stored);
+		return;
+	}
+#endif
+
+	if (unlikely(!handle))
+		return;
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page(handle);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(zram->mem_pool, page, offset);
+	clen = zram->table[index].size;
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
+	if (!zram_dedup_enabled(zram)) {
+		zs_free(zram->mem_pool, handle);
+	} else if (!zram_dedup_put(zram, handle)) {
+		/* Object is still shared, its size stays accounted */
+		zram_stat_dec(&zram->stats.pages_dup);
+		clen = 0;
+	}
+
 out:
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].handle = NULL;
+	zram->table[index].size = 0;
 }
 
-static void handle_zero_page(struct page *page)
+static void handle_same_page(struct page *page, unsigned long element)
 {
-	void *user_mem;
+	unsigned int pos;
+	unsigned long *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
+	if (!element) {
+		memset(user_mem, 0, PAGE_SIZE);
+	} else {
+		for (pos = 0; pos != PAGE_SIZE / sizeof(*user_mem); pos++)
+			user_mem[pos] = element;
+	}
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
@@ -194,8 +466,7 @@ static void handle_uncompressed_page(struct zram *zram,
 	unsigned char *user_mem, *cmem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = kmap_atomic(zram->table[index].handle, KM_USER1);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
 	kunmap_atomic(user_mem, KM_USER0);
@@ -204,81 +475,182 @@ static void handle_uncompressed_page(struct zram *zram,
 	flush_dcache_page(page);
 }
 
-static void zram_read(struct zram *zram, struct bio *bio)
+/*
+ * Decompress the page stored at index into page. Called with the slot
+ * lock held, for a slot which holds a compressed or uncompressed page.
+ */
+static int zram_decompress_page(struct zram *zram, struct page *page,
+				u32 index)
 {
+	int ret;
+	size_t clen = PAGE_SIZE;
+	void *handle;
+	unsigned char *user_mem, *cmem;
 
-	int i;
-	u32 index;
-	struct bio_vec *bvec;
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		handle_uncompressed_page(zram, page, index);
+		return 0;
+	}
 
-	zram_stat64_inc(zram, &zram->stats.num_reads);
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	user_mem = kmap_atomic(page, KM_USER0);
 
-	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		size_t clen;
-		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
+	handle = zram_get_handle(zram, index);
+	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
 
-		page = bvec->bv_page;
+	ret = zram->backend->decompress(cmem, zram->table[index].size,
+		user_mem, &clen);
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
-			index++;
-			continue;
-		}
+	zs_unmap_object(zram->mem_pool, handle);
+	kunmap_atomic(user_mem, KM_USER0);
 
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			handle_zero_page(page);
-			index++;
-			continue;
-		}
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret)) {
+		pr_err("Decompression failed! err=%d, page=%u\n",
+			ret, index);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return -EIO;
+	}
 
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
-			index++;
-			continue;
+	flush_dcache_page(page);
+	return 0;
+}
+
+/*
+ * Returns -EAGAIN if the page is on the backing device and the caller
+ * cannot sleep.
+ */
+static int zram_read_page(struct zram *zram, struct page *page, u32 index,
+			int can_sleep)
+{
+	int ret;
+
+	zram_slot_lock(zram, index);
+	zram_accessed(zram, index);
+
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		unsigned long element = zram->table[index].element;
+
+		zram_slot_unlock(zram, index);
+		handle_same_page(page, element);
+		return 0;
+	}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		unsigned long blk_idx = zram->table[index].element;
+
+		zram_slot_unlock(zram, index);
+		if (!can_sleep)
+			return -EAGAIN;
+
+		/*
+		 * The block can be freed by an overwrite as soon as the slot
+		 * is unlocked. Once bd_rwsem is held it can no longer be
+		 * rewritten, so check that the slot still points at it.
+		 */
+		down_read(&zram->bd_rwsem);
+		zram_slot_lock(zram, index);
+		if (!zram_test_flag(zram, index, ZRAM_WB) ||
+				zram->table[index].element != blk_idx) {
+			zram_slot_unlock(zram, index);
+			up_read(&zram->bd_rwsem);
+			return zram_read_page(zram, page, index, can_sleep);
 		}
+		zram_slot_unlock(zram, index);
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
+		ret = zram_read_from_bdev(zram, page, blk_idx);
+		up_read(&zram->bd_rwsem);
+		return ret;
+	}
+#endif
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+	/* Requested page is not present in compressed area */
+	if (unlikely(!zram->table[index].handle)) {
+		zram_slot_unlock(zram, index);
+		pr_debug("Read before write: page=%u\n", index);
+		handle_same_page(page, 0);
+		return 0;
+	}
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
+	ret = zram_decompress_page(zram, page, index);
+	zram_slot_unlock(zram, index);
 
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+	return ret;
+}
+
+static int zram_read(struct zram *zram, struct bio *bio, int can_sleep)
+{
+	int i, ret;
+	u32 index;
+	struct bio_vec *bvec;
 
-		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
-			pr_err("Decompression failed! err=%d, page=%u\n",
-				ret, index);
-			zram_stat64_inc(zram, &zram->stats.failed_reads);
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+
+	bio_for_each_segment(bvec, bio, i) {
+		ret = zram_read_page(zram, bvec->bv_page, index, can_sleep);
+		if (ret == -EAGAIN)
+			return ret;
+		if (unlikely(ret))
 			goto out;
-		}
 
-		flush_dcache_page(page);
 		index++;
 	}
 
 	set_bit(BIO_UPTODATE, &bio->bi_flags);
 	bio_endio(bio, 0);
-	return;
+	return 0;
 
 out:
 	bio_io_error(bio);
+	return 0;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+struct zram_read_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct bio *bio;
+};
+
+static void zram_read_work_fn(struct work_struct *work)
+{
+	struct zram_read_work *rw;
+
+	rw = container_of(work, struct zram_read_work, work);
+	zram_read(rw->zram, rw->bio, 1);
+	kfree(rw);
+}
+
+/*
+ * Pages on the backing device are read synchronously. That cannot be
+ * done from make_request, since bios submitted there are only issued
+ * once it returns, so hand the bio over to a worker instead. The
+ * workqueue is the device's own, so that reset can wait for these reads
+ * before it frees what they use.
+ */
+static void zram_defer_read(struct zram *zram, struct bio *bio)
+{
+	struct zram_read_work *rw;
+
+	rw = kmalloc(sizeof(*rw), GFP_NOIO);
+	if (!rw) {
+		bio_io_error(bio);
+		return;
+	}
+
+	INIT_WORK(&rw->work, zram_read_work_fn);
+	rw->zram = zram;
+	rw->bio = bio;
+	queue_work(zram->read_wq, &rw->work);
+}
+#else
+static void zram_defer_read(struct zram *zram, struct bio *bio)
+{
+	bio_io_error(bio);
+}
+#endif
+
 static void zram_write(struct zram *zram, struct bio *bio)
 {
 	int i;
@@ -290,42 +662,73 @@ static void zram_write(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		u32 offset;
+		u32 checksum = 0;
 		size_t clen;
-		struct zobj_header *zheader;
+		void *handle;
+		unsigned long element;
 		struct page *page, *page_store;
+		struct zram_strm *strm;
+		struct zram_entry *entry;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
 
 		/*
 		 * System overwrites unused sectors. Free memory associated
 		 * with this sector now.
 		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
+		zram_slot_lock(zram, index);
+		if (zram->table[index].handle ||
+				zram_test_flag(zram, index, ZRAM_SAME))
 			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
+		zram_slot_unlock(zram, index);
 
 		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
+		if (page_same_filled(user_mem, &element)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
+			if (element)
+				zram_stat_inc(&zram->stats.pages_same);
+			else
+				zram_stat_inc(&zram->stats.pages_zero);
+			zram_slot_lock(zram, index);
+			zram->table[index].element = element;
+			zram_set_flag(zram, index, ZRAM_SAME);
+			zram_accessed(zram, index);
+			zram_slot_unlock(zram, index);
 			index++;
 			continue;
 		}
+		if (zram_dedup_enabled(zram))
+			checksum = zram_dedup_checksum(user_mem);
+		kunmap_atomic(user_mem, KM_USER0);
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		strm = zram_get_strm(zram);
+		src = strm->buffer;
+
+		if (zram_dedup_enabled(zram)) {
+			entry = zram_dedup_find(zram, page, checksum, src);
+			if (entry) {
+				zram_slot_lock(zram, index);
+				zram->table[index].handle = entry;
+				zram->table[index].size = entry->len;
+				zram_accessed(zram, index);
+				zram_slot_unlock(zram, index);
+				zram_stat64_inc(zram, &zram->stats.dedup_hits);
+				zram_stat_inc(&zram->stats.pages_dup);
+				/* Already accounted in compr_size */
+				clen = entry->len;
+				goto update_count;
+			}
+		}
+
+		user_mem = kmap_atomic(page, KM_USER0);
+		ret = zram->backend->compress(user_mem, PAGE_SIZE, src, &clen,
+					strm->workmem);
 
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+		if (unlikely(ret)) {
+			zram_put_strm(zram, strm);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
@@ -340,7 +743,7 @@ static void zram_write(struct zram *zram, struct bio *bio)
 			clen = PAGE_SIZE;
 			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
+				zram_put_strm(zram, strm);
 				pr_info("Error allocating memory for "
 					"incompressible page: %u\n", index);
 				zram_stat64_inc(zram,
@@ -348,52 +751,63 @@ static void zram_write(struct zram *zram, struct bio *bio)
 				goto out;
 			}
 
-			offset = 0;
+			src = kmap_atomic(page, KM_USER0);
+			cmem = kmap_atomic(page_store, KM_USER1);
+			memcpy(cmem, src, clen);
+			kunmap_atomic(cmem, KM_USER1);
+			kunmap_atomic(src, KM_USER0);
+
+			zram_slot_lock(zram, index);
+			zram->table[index].handle = page_store;
 			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+			zram_accessed(zram, index);
+			zram_slot_unlock(zram, index);
+
 			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
+			zram_wb_kick_huge(zram);
+			goto update_stats;
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
+		handle = zs_malloc(zram->mem_pool, clen);
+		if (!handle) {
+			zram_put_strm(zram, strm);
 			pr_info("Error allocating memory for compressed "
 				"page: %u, size=%zu\n", index, clen);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+		memcpy(cmem, src, clen);
+		zs_unmap_object(zram->mem_pool, handle);
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
+		if (zram_dedup_enabled(zram)) {
+			entry = zram_dedup_add(zram, handle, clen, checksum);
+			if (!entry) {
+				zs_free(zram->mem_pool, handle);
+				zram_put_strm(zram, strm);
+				zram_stat64_inc(zram,
+					&zram->stats.failed_writes);
+				goto out;
+			}
+			handle = entry;
 		}
-#endif
 
-		memcpy(cmem, src, clen);
-
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+		zram_slot_lock(zram, index);
+		zram->table[index].handle = handle;
+		zram->table[index].size = clen;
+		zram_accessed(zram, index);
+		zram_slot_unlock(zram, index);
 
+update_stats:
 		/* Update stats */
 		zram_stat64_add(zram, &zram->stats.compr_size, clen);
+update_count:
 		zram_stat_inc(&zram->stats.pages_stored);
 		if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
 
-		mutex_unlock(&zram->lock);
+		zram_put_strm(zram, strm);
 		index++;
 	}
 
@@ -442,7 +856,9 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 
 	switch (bio_data_dir(bio)) {
 	case READ:
-		zram_read(zram, bio);
+		zram_stat64_inc(zram, &zram->stats.num_reads);
+		if (zram_read(zram, bio, 0) == -EAGAIN)
+			zram_defer_read(zram, bio);
 		break;
 
 	case WRITE:
@@ -453,43 +869,333 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 	return 0;
 }
 
+ssize_t zram_backend_show(struct zram *zram, char *buf)
+{
+	int i;
+	ssize_t sz = 0;
+
+	for (i = 0; i < ARRAY_SIZE(zram_backends); i++) {
+		const struct zram_backend *backend = &zram_backends[i];
+
+		if (backend == zram->backend)
+			sz += sprintf(buf + sz, "[%s] ", backend->name);
+		else
+			sz += sprintf(buf + sz, "%s ", backend->name);
+	}
+	/* Replace the trailing space with a newline */
+	buf[sz - 1] = '\n';
+
+	return sz;
+}
+
+int zram_backend_store(struct zram *zram, const char *buf)
+{
+	int i, ret = -EINVAL;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(zram_backends); i++) {
+		if (sysfs_streq(buf, zram_backends[i].name)) {
+			zram->backend = &zram_backends[i];
+			ret = 0;
+			break;
+		}
+	}
+
+out:
+	mutex_unlock(&zram->init_lock);
+	return ret;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Called with the slot lock held */
+static int zram_wb_candidate(struct zram *zram, u32 index,
+			enum zram_wb_mode mode)
+{
+	if (!zram->table[index].handle ||
+			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_WB))
+		return 0;
+
+	if (mode == ZRAM_WB_HUGE)
+		return zram_test_flag(zram, index, ZRAM_UNCOMPRESSED);
+
+	return time_after_eq(jiffies, zram->table[index].ac_time +
+				zram->wb_idle_age * HZ);
+}
+
+/**
+ * zram_writeback - move pages to the backing device
+ * @zram: initialized device with a backing device
+ * @mode: which pages to write back
+ *
+ * Each page is copied out under its slot lock and written
+ * synchronously. If the slot was rewritten or freed meanwhile the
+ * copy is discarded, otherwise its memory is released and the slot
+ * points at the backing device block.
+ */
+int zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	int ret = 0;
+	u32 index, num_pages;
+	unsigned long blk_idx = 0;
+	struct page *page;
+
+	if (!zram->bdev)
+		return -ENODEV;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	mutex_lock(&zram->wb_lock);
+	num_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < num_pages; index++) {
+		if (!blk_idx) {
+			blk_idx = zram_alloc_block(zram);
+			if (!blk_idx) {
+				ret = -ENOSPC;
+				break;
+			}
+		}
+
+		zram_slot_lock(zram, index);
+		if (!zram_wb_candidate(zram, index, mode) ||
+				zram_decompress_page(zram, page, index)) {
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		zram_slot_unlock(zram, index);
+
+		down_write(&zram->bd_rwsem);
+		ret = zram_bdev_rw(zram, page, blk_idx, WRITE);
+		up_write(&zram->bd_rwsem);
+		if (ret) {
+			pr_err("Backing device write failed! err=%d, "
+				"block=%lu\n", ret, blk_idx);
+			zram_slot_lock(zram, index);
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_slot_unlock(zram, index);
+			break;
+		}
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+
+		zram_slot_lock(zram, index);
+		if (!zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			/* Page changed under us, reuse the block */
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+		zram_free_page(zram, index);
+		zram->table[index].element = blk_idx;
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_slot_unlock(zram, index);
+
+		zram_stat_inc(&zram->stats.pages_stored);
+		zram_stat_inc(&zram->stats.pages_wb);
+		blk_idx = 0;
+
+		cond_resched();
+	}
+
+	if (blk_idx)
+		zram_free_block(zram, blk_idx);
+	mutex_unlock(&zram->wb_lock);
+
+	__free_page(page);
+	return ret;
+}
+
+static void zram_wb_huge_fn(struct work_struct *work)
+{
+	struct zram *zram = container_of(to_delayed_work(work), struct zram,
+					wb_huge_work);
+
+	/* A kick can race with reset, so the device may be gone */
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done)
+		zram_writeback(zram, ZRAM_WB_HUGE);
+	mutex_unlock(&zram->init_lock);
+}
+
+static void zram_wb_idle_fn(struct work_struct *work)
+{
+	struct zram *zram = container_of(to_delayed_work(work), struct zram,
+					wb_idle_work);
+	unsigned int age;
+
+	mutex_lock(&zram->init_lock);
+	age = zram->wb_idle_age;
+	if (zram->init_done && age) {
+		zram_writeback(zram, ZRAM_WB_IDLE);
+		if (!zram->wb_stop)
+			queue_delayed_work(system_long_wq,
+					&zram->wb_idle_work, age * HZ);
+	}
+	mutex_unlock(&zram->init_lock);
+}
+
+/*
+ * Stop background writeback. The work functions take init_lock, so
+ * this must be called without it.
+ */
+static void zram_wb_stop(struct zram *zram)
+{
+	zram->wb_stop = 1;
+	smp_mb();
+	cancel_delayed_work_sync(&zram->wb_huge_work);
+	cancel_delayed_work_sync(&zram->wb_idle_work);
+}
+
+static void zram_release_bdev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	down_write(&zram->bd_rwsem);
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	vfree(zram->bitmap);
+	kfree(zram->backing_dev);
+
+	zram->bdev = NULL;
+	zram->bitmap = NULL;
+	zram->backing_dev = NULL;
+	zram->nr_pages = 0;
+	up_write(&zram->bd_rwsem);
+}
+
+ssize_t zram_backing_dev_show(struct zram *zram, char *buf)
+{
+	ssize_t sz;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->bdev)
+		sz = sprintf(buf, "%s\n", zram->backing_dev);
+	else
+		sz = sprintf(buf, "none\n");
+	mutex_unlock(&zram->init_lock);
+
+	return sz;
+}
+
+int zram_backing_dev_store(struct zram *zram, const char *buf)
+{
+	int ret;
+	size_t len;
+	char *path;
+	unsigned long nr_pages, *bitmap = NULL;
+	struct block_device *bdev = NULL;
+
+	path = kstrndup(buf, PATH_MAX, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+
+	len = strlen(path);
+	if (len && path[len - 1] == '\n')
+		path[len - 1] = '\0';
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (!strcmp(path, "none")) {
+		zram_release_bdev(zram);
+		ret = 0;
+		goto out;
+	}
+
+	bdev = blkdev_get_by_path(path, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				zram);
+	if (IS_ERR(bdev)) {
+		ret = PTR_ERR(bdev);
+		bdev = NULL;
+		goto out;
+	}
+
+	ret = set_blocksize(bdev, PAGE_SIZE);
+	if (ret)
+		goto out;
+
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	zram_release_bdev(zram);
+	zram->bdev = bdev;
+	zram->backing_dev = path;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	mutex_unlock(&zram->init_lock);
+
+	pr_info("Using backing device %s (%lu pages)\n", path, nr_pages);
+	return 0;
+
+out:
+	if (bdev)
+		blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	kfree(path);
+	mutex_unlock(&zram->init_lock);
+
+	return ret;
+}
+#endif
+
 void zram_reset_device(struct zram *zram)
 {
 	size_t index;
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_wb_stop(zram);
+#endif
 	mutex_lock(&zram->init_lock);
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Deferred reads use the streams, the table and the backing device */
+	if (zram->read_wq)
+		flush_workqueue(zram->read_wq);
+#endif
 
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free various per-device buffers */
+	zram_destroy_strms(zram);
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
+		void *handle = zram->table[index].handle;
 
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
-
-		if (!page)
+		if (!handle || zram_test_flag(zram, index, ZRAM_SAME) ||
+				zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
+			__free_page(handle);
+		else if (zram_dedup_enabled(zram))
+			zram_dedup_put(zram, handle);
 		else
-			xv_free(zram->mem_pool, page, offset);
+			zs_free(zram->mem_pool, handle);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_release_bdev(zram);
+#endif
+
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -511,17 +1217,9 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	ret = zram_create_strms(zram);
+	if (ret) {
+		pr_err("Error allocating compression streams!\n");
 		goto fail;
 	}
 
@@ -540,7 +1238,7 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -548,6 +1246,12 @@ int zram_init_device(struct zram *zram)
 	}
 
 	zram->init_done = 1;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram->wb_stop = 0;
+	if (zram->bdev && zram->wb_idle_age)
+		queue_delayed_work(system_long_wq, &zram->wb_idle_work,
+				zram->wb_idle_age * HZ);
+#endif
 	mutex_unlock(&zram->init_lock);
 
 	pr_debug("Initialization done!\n");
@@ -566,7 +1270,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	zram_slot_lock(zram, index);
 	zram_free_page(zram, index);
+	zram_slot_unlock(zram, index);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -579,9 +1285,20 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	spin_lock_init(&zram->strm_lock);
+	INIT_LIST_HEAD(&zram->idle_strm);
+	init_waitqueue_head(&zram->strm_wait);
+	spin_lock_init(&zram->dedup_lock);
+	zram->dedup_root = RB_ROOT;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	mutex_init(&zram->wb_lock);
+	init_rwsem(&zram->bd_rwsem);
+	INIT_DELAYED_WORK(&zram->wb_huge_work, zram_wb_huge_fn);
+	INIT_DELAYED_WORK(&zram->wb_idle_work, zram_wb_idle_fn);
+#endif
+	zram->backend = &zram_backends[0];
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -633,6 +1350,16 @@ static int create_device(struct zram *zram, int device_id)
 		goto out;
 	}
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram->read_wq = alloc_workqueue("zram_read", WQ_MEM_RECLAIM, 0);
+	if (!zram->read_wq) {
+		pr_warning("Error allocating read workqueue for device %d\n",
+			device_id);
+		ret = -ENOMEM;
+		goto out;
+	}
+#endif
+
 	zram->init_done = 0;
 
 out:
@@ -651,6 +1378,13 @@ static void destroy_device(struct zram *zram)
 
 	if (zram->queue)
 		blk_cleanup_queue(zram->queue);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* No new reads can come in; this waits for the deferred ones */
+	if (zram->read_wq)
+		destroy_workqueue(zram->read_wq);
+	zram->read_wq = NULL;
+#endif
 }
 
 static int __init zram_init(void)
@@ -713,6 +1447,10 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+		/* a kick can outlive a reset done through sysfs */
+		zram_wb_stop(zram);
+#endif
 	}
 
 	unregister_blkdev(zram_major, "zram");
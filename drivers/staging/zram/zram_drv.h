@@ -17,8 +17,12 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/rbtree.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
+#include "zram_dedup.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +30,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -51,8 +43,8 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -68,8 +60,20 @@ enum zram_pageflags {
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page is filled with one repeated word, kept in table.element.
+	 * Nothing is allocated for it.
+	 */
+	ZRAM_SAME,
+
+	/* Page lives on the backing device, at block table.element */
+	ZRAM_WB,
+
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
+
+	/* Slot lock, see zram_slot_lock() */
+	ZRAM_LOCK,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -78,10 +82,19 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
-	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
+	union {
+		/*
+		 * zsmalloc handle (zram_entry with dedup enabled), or
+		 * page if ZRAM_UNCOMPRESSED
+		 */
+		void *handle;
+		unsigned long element;	/* fill word if ZRAM_SAME */
+	};
+	unsigned long flags;
+	u16 size;	/* object size (excluding header) */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	unsigned long ac_time;	/* jiffies of last read or write */
+#endif
 } __attribute__((aligned(4)));
 
 struct zram_stats {
@@ -92,23 +105,58 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	u64 strm_waits;		/* no. of writes that waited for a stream */
+	u64 strm_wait_ns;	/* total time writes waited for a stream */
+	u64 dedup_hits;		/* no. of writes matched a stored page */
+	u64 bd_reads;		/* no. of pages read from backing device */
+	u64 bd_writes;		/* no. of pages written to backing device */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_same;	/* no. of other same filled pages */
+	atomic_t pages_dup;	/* no. of pages sharing a stored object */
+	atomic_t pages_wb;	/* no. of pages on the backing device */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+};
+
+/*
+ * Compression workspace. Each device keeps one per possible CPU so that
+ * concurrent writers compress in parallel.
+ */
+struct zram_strm {
+	void *workmem;		/* compressor working memory */
+	void *buffer;		/* compressed output, two pages */
+	struct list_head list;
+};
+
+/*
+ * Compression backend. Both callbacks follow the lzo1x calling
+ * convention and return 0 on success.
+ */
+struct zram_backend {
+	const char *name;
+	size_t workmem_size;
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len);
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	const struct zram_backend *backend;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	spinlock_t strm_lock;	/* protect idle_strm */
+	struct list_head idle_strm;
+	wait_queue_head_t strm_wait;
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
+	int use_dedup;
+	/* Protect dedup_root and zram_entry refcounts */
+	spinlock_t dedup_lock;
+	struct rb_root dedup_root;
 	/* Prevent concurrent execution of device init and reset */
 	struct mutex init_lock;
 	/*
@@ -116,10 +164,42 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/*
+	 * Optional backing device for incompressible and idle pages.
+	 * Can only be set before the device is initialized.
+	 */
+	struct block_device *bdev;
+	char *backing_dev;		/* path the bdev was opened with */
+	unsigned long *bitmap;		/* allocated backing device blocks */
+	unsigned long nr_pages;		/* backing device size in pages */
+	unsigned int wb_idle_age;	/* seconds, 0 disables idle writeback */
+	struct mutex wb_lock;		/* serialize writeback passes */
+	/*
+	 * Held for read across a backing device read and for write across
+	 * a writeback, so a block freed under a reader cannot be reused
+	 * and overwritten before the read completes.
+	 */
+	struct rw_semaphore bd_rwsem;
+	int wb_stop;			/* reset in progress, do not kick */
+	/* Reads of pages on the backing device, flushed on reset */
+	struct workqueue_struct *read_wq;
+	struct delayed_work wb_huge_work;
+	struct delayed_work wb_idle_work;
+#endif
 
 	struct zram_stats stats;
 };
 
+static inline int zram_dedup_enabled(struct zram *zram)
+{
+#ifdef CONFIG_ZRAM_DEDUP
+	return zram->use_dedup;
+#else
+	return 0;
+#endif
+}
+
 extern struct zram *devices;
 extern unsigned int num_devices;
 #ifdef CONFIG_SYSFS
@@ -128,5 +208,18 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern ssize_t zram_backend_show(struct zram *zram, char *buf);
+extern int zram_backend_store(struct zram *zram, const char *buf);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+enum zram_wb_mode {
+	ZRAM_WB_HUGE,	/* pages stored uncompressed */
+	ZRAM_WB_IDLE,	/* pages not accessed for wb_idle_age seconds */
+};
+
+extern ssize_t zram_backing_dev_show(struct zram *zram, char *buf);
+extern int zram_backing_dev_store(struct zram *zram, const char *buf);
+extern int zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+#endif
 
 #endif
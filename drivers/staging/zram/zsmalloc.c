@@ -0,0 +1,717 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Objects are grouped into size classes ZS_SIZE_CLASS_DELTA bytes
+ * apart. Each class carves its objects out of zspages: groups of up to
+ * ZS_MAX_PAGES_PER_ZSPAGE 0-order pages treated as one linear area, so
+ * objects are packed across page boundaries and the only internal
+ * waste is the rounding to the class size. The number of pages per
+ * zspage is chosen per class to minimize the unusable tail.
+ *
+ * Callers get an opaque handle instead of a <page, offset> pair. The
+ * handle points to a small descriptor which records where the object
+ * currently lives, and every object starts with a back-pointer to its
+ * handle. That lets zs_compact() move objects out of sparsely used
+ * zspages and release them, which xvmalloc could never do.
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static struct kmem_cache *zs_handle_cachep;
+static struct kmem_cache *zs_zspage_cachep;
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * Find the number of pages per zspage which leaves the smallest
+ * unusable tail for objects of the given size.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size;
+		int waste, usedpc;
+
+		zspage_size = i * PAGE_SIZE;
+		waste = zspage_size % class_size;
+		usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static unsigned long obj_offset(struct size_class *class, unsigned int idx)
+{
+	return (unsigned long)idx * class->size;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+	unsigned int max_objects = class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max_objects)
+		return ZS_FULL;
+	if (inuse <= 3 * max_objects / ZS_FULLNESS_THRESHOLD_FRAC)
+		return ZS_ALMOST_EMPTY;
+
+	return ZS_ALMOST_FULL;
+}
+
+/*
+ * Move zspage to the fullness list matching its current usage. Empty
+ * zspages (and zspages isolated for compaction, which are marked
+ * ZS_EMPTY) are kept off all lists.
+ */
+static void fix_fullness_group(struct size_class *class,
+				struct zspage *zspage)
+{
+	enum fullness_group newfg;
+
+	newfg = get_fullness_group(class, zspage);
+	if (newfg == zspage->fullness)
+		return;
+
+	list_del_init(&zspage->list);
+	zspage->fullness = newfg;
+	if (newfg != ZS_EMPTY)
+		list_add(&zspage->list, &class->fullness_list[newfg]);
+}
+
+/*
+ * Copy between a linear buffer and a (possibly page straddling)
+ * range within a zspage.
+ */
+static void copy_from_zspage(char *buf, struct zspage *zspage,
+				unsigned long off, int len)
+{
+	while (len) {
+		unsigned long poff = off & ~PAGE_MASK;
+		int n = min_t(int, len, PAGE_SIZE - poff);
+		char *addr;
+
+		addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+		memcpy(buf, addr + poff, n);
+		kunmap_atomic(addr, KM_USER1);
+
+		buf += n;
+		off += n;
+		len -= n;
+	}
+}
+
+static void copy_to_zspage(struct zspage *zspage, unsigned long off,
+				const char *buf, int len)
+{
+	while (len) {
+		unsigned long poff = off & ~PAGE_MASK;
+		int n = min_t(int, len, PAGE_SIZE - poff);
+		char *addr;
+
+		addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+		memcpy(addr + poff, buf, n);
+		kunmap_atomic(addr, KM_USER1);
+
+		buf += n;
+		off += n;
+		len -= n;
+	}
+}
+
+/* Object offsets are ZS_SIZE_CLASS_DELTA aligned: the header fits a page */
+static struct zs_handle *get_obj_handle(struct size_class *class,
+				struct zspage *zspage, unsigned int idx)
+{
+	unsigned long off = obj_offset(class, idx);
+	unsigned long *addr;
+	struct zs_handle *handle;
+
+	addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+	handle = (struct zs_handle *)addr[(off & ~PAGE_MASK) / ZS_HANDLE_SIZE];
+	kunmap_atomic(addr, KM_USER1);
+
+	return handle;
+}
+
+static void set_obj_handle(struct size_class *class, struct zspage *zspage,
+				unsigned int idx, struct zs_handle *handle)
+{
+	unsigned long off = obj_offset(class, idx);
+	unsigned long *addr;
+
+	addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+	addr[(off & ~PAGE_MASK) / ZS_HANDLE_SIZE] = (unsigned long)handle;
+	kunmap_atomic(addr, KM_USER1);
+}
+
+static void free_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	int i;
+
+	for (i = 0; i < zspage->class->pages_per_zspage; i++)
+		__free_page(zspage->pages[i]);
+
+	atomic_long_sub(zspage->class->pages_per_zspage,
+			&pool->pages_allocated);
+	kmem_cache_free(zs_zspage_cachep, zspage);
+}
+
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+				struct size_class *class)
+{
+	int i;
+	struct zspage *zspage;
+
+	zspage = kmem_cache_zalloc(zs_zspage_cachep,
+				pool->flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(pool->flags);
+		if (!zspage->pages[i])
+			goto fail;
+	}
+
+	atomic_long_add(class->pages_per_zspage, &pool->pages_allocated);
+	return zspage;
+
+fail:
+	while (--i >= 0)
+		__free_page(zspage->pages[i]);
+	kmem_cache_free(zs_zspage_cachep, zspage);
+	return NULL;
+}
+
+/* Allocation prefers the fullest zspages to keep the others drainable */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	if (!list_empty(&class->fullness_list[ZS_ALMOST_FULL]))
+		return list_first_entry(&class->fullness_list[ZS_ALMOST_FULL],
+					struct zspage, list);
+
+	if (!list_empty(&class->fullness_list[ZS_ALMOST_EMPTY]))
+		return list_first_entry(&class->fullness_list[ZS_ALMOST_EMPTY],
+					struct zspage, list);
+
+	return NULL;
+}
+
+/* Called with class->lock held */
+static unsigned int obj_alloc(struct size_class *class, struct zspage *zspage)
+{
+	unsigned int idx;
+
+	idx = find_first_zero_bit(zspage->used, class->objs_per_zspage);
+	BUG_ON(idx >= class->objs_per_zspage);
+
+	__set_bit(idx, zspage->used);
+	zspage->inuse++;
+	class->inuse++;
+	fix_fullness_group(class, zspage);
+
+	return idx;
+}
+
+/* Called with class->lock held */
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int idx)
+{
+	BUG_ON(!test_bit(idx, zspage->used));
+
+	__clear_bit(idx, zspage->used);
+	zspage->inuse--;
+	class->inuse--;
+}
+
+/**
+ * zs_malloc - allocate object of given size from pool
+ * @pool: pool to allocate from
+ * @size: size of object to allocate
+ *
+ * Returns an opaque handle to the object, or NULL if the size is out
+ * of range or no memory is available. The object must be accessed
+ * through zs_map_object().
+ */
+void *zs_malloc(struct zs_pool *pool, size_t size)
+{
+	unsigned int idx;
+	struct zs_handle *handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return NULL;
+
+	handle = kmem_cache_alloc(zs_handle_cachep,
+				pool->flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return NULL;
+	handle->flags = 0;
+
+	class = &pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(pool, class);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(zs_handle_cachep, handle);
+			return NULL;
+		}
+		spin_lock(&class->lock);
+		class->zspages++;
+	}
+
+	idx = obj_alloc(class, zspage);
+	set_obj_handle(class, zspage, idx, handle);
+	handle->zspage = zspage;
+	handle->idx = idx;
+	spin_unlock(&class->lock);
+
+	return handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+/**
+ * zs_free - free object allocated with zs_malloc()
+ * @pool: pool the object was allocated from
+ * @handle: handle returned by zs_malloc()
+ */
+void zs_free(struct zs_pool *pool, void *handle)
+{
+	struct zs_handle *h = handle;
+	struct size_class *class;
+	struct zspage *zspage;
+	int empty = 0;
+
+	if (unlikely(!h))
+		return;
+
+	/* Keep compaction from moving the object under us */
+	bit_spin_lock(ZS_HANDLE_PIN_BIT, &h->flags);
+	zspage = h->zspage;
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, h->idx);
+	fix_fullness_group(class, zspage);
+	if (!zspage->inuse) {
+		class->zspages--;
+		empty = 1;
+	}
+	spin_unlock(&class->lock);
+	bit_spin_unlock(ZS_HANDLE_PIN_BIT, &h->flags);
+
+	if (empty)
+		free_zspage(pool, zspage);
+	kmem_cache_free(zs_handle_cachep, h);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle
+ * @pool: pool the object was allocated from
+ * @handle: handle returned by zs_malloc()
+ * @mm: how the object is going to be accessed
+ *
+ * The object is pinned against compaction and preemption is disabled
+ * until zs_unmap_object() is called, so the caller must not sleep and
+ * may only map one object at a time.
+ */
+void *zs_map_object(struct zs_pool *pool, void *handle, enum zs_mapmode mm)
+{
+	struct zs_handle *h = handle;
+	struct mapping_area *area;
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned long off;
+
+	bit_spin_lock(ZS_HANDLE_PIN_BIT, &h->flags);
+	zspage = h->zspage;
+	class = zspage->class;
+	off = obj_offset(class, h->idx);
+
+	area = this_cpu_ptr(pool->area);
+	area->vm_mm = mm;
+
+	if ((off & ~PAGE_MASK) + class->size <= PAGE_SIZE) {
+		/* Object lies entirely within one page: map it directly */
+		area->vm_addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT],
+					KM_USER1);
+		return area->vm_addr + (off & ~PAGE_MASK) + ZS_HANDLE_SIZE;
+	}
+
+	/* Object straddles pages: bounce it through the per-cpu buffer */
+	area->vm_addr = NULL;
+	if (mm != ZS_MM_WO)
+		copy_from_zspage(area->vm_buf + ZS_HANDLE_SIZE, zspage,
+				off + ZS_HANDLE_SIZE,
+				class->size - ZS_HANDLE_SIZE);
+
+	return area->vm_buf + ZS_HANDLE_SIZE;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, void *handle)
+{
+	struct zs_handle *h = handle;
+	struct mapping_area *area;
+	struct size_class *class;
+
+	area = this_cpu_ptr(pool->area);
+	if (area->vm_addr) {
+		kunmap_atomic(area->vm_addr, KM_USER1);
+	} else if (area->vm_mm != ZS_MM_RO) {
+		class = h->zspage->class;
+		copy_to_zspage(h->zspage,
+				obj_offset(class, h->idx) + ZS_HANDLE_SIZE,
+				area->vm_buf + ZS_HANDLE_SIZE,
+				class->size - ZS_HANDLE_SIZE);
+	}
+
+	bit_spin_unlock(ZS_HANDLE_PIN_BIT, &h->flags);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * A class can release at least one zspage if its free object slots
+ * add up to a whole zspage.
+ */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_wasted;
+
+	obj_wasted = class->zspages * class->objs_per_zspage - class->inuse;
+	return obj_wasted / class->objs_per_zspage;
+}
+
+/* Take the least recently filled sparse zspage off its list */
+static struct zspage *isolate_src_zspage(struct size_class *class)
+{
+	static const enum fullness_group fg[] = {
+		ZS_ALMOST_EMPTY, ZS_ALMOST_FULL
+	};
+	struct zspage *zspage;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fg); i++) {
+		if (list_empty(&class->fullness_list[fg[i]]))
+			continue;
+
+		zspage = list_entry(class->fullness_list[fg[i]].prev,
+					struct zspage, list);
+		list_del_init(&zspage->list);
+		zspage->fullness = ZS_EMPTY;
+		return zspage;
+	}
+
+	return NULL;
+}
+
+/*
+ * Move every object of the isolated zspage src into other zspages of
+ * the same class. Returns -EBUSY if an object is currently mapped or
+ * being freed; objects moved so far stay moved.
+ */
+static int migrate_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *src)
+{
+	struct mapping_area *area = this_cpu_ptr(pool->area);
+	unsigned int idx = 0;
+
+	while ((idx = find_next_bit(src->used, class->objs_per_zspage, idx))
+			< class->objs_per_zspage) {
+		struct zs_handle *h = get_obj_handle(class, src, idx);
+		struct zspage *dst;
+		unsigned int didx;
+
+		if (!bit_spin_trylock(ZS_HANDLE_PIN_BIT, &h->flags))
+			return -EBUSY;
+
+		/* zs_can_compact() guarantees there is room elsewhere */
+		dst = find_get_zspage(class);
+		BUG_ON(!dst);
+		didx = obj_alloc(class, dst);
+
+		/* Copy the whole object, handle back-pointer included */
+		copy_from_zspage(area->vm_buf, src, obj_offset(class, idx),
+				class->size);
+		copy_to_zspage(dst, obj_offset(class, didx), area->vm_buf,
+				class->size);
+
+		h->zspage = dst;
+		h->idx = didx;
+		obj_free(class, src, idx);
+		bit_spin_unlock(ZS_HANDLE_PIN_BIT, &h->flags);
+
+		idx++;
+	}
+
+	return 0;
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				struct size_class *class, unsigned long nr_pages)
+{
+	unsigned long freed = 0;
+	struct zspage *src;
+
+	spin_lock(&class->lock);
+	while (freed < nr_pages && zs_can_compact(class)) {
+		src = isolate_src_zspage(class);
+		if (!src)
+			break;
+
+		if (migrate_zspage(pool, class, src)) {
+			/* Put it back and give up on this class for now */
+			fix_fullness_group(class, src);
+			break;
+		}
+
+		class->zspages--;
+		free_zspage(pool, src);
+		freed += class->pages_per_zspage;
+
+		cond_resched_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return freed;
+}
+
+/**
+ * zs_compact - release sparsely used zspages
+ * @pool: pool to compact
+ *
+ * Moves objects out of partially used zspages into other zspages of
+ * the same size class, releasing the emptied ones. May sleep.
+ *
+ * Returns the number of pages released.
+ */
+/* Compact until at least @nr_pages pages are released, or nothing is left */
+static unsigned long __zs_compact(struct zs_pool *pool, unsigned long nr_pages)
+{
+	int i;
+	unsigned long freed = 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES && freed < nr_pages; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		/* Unlocked peek; zs_compact_class() rechecks */
+		if (!zs_can_compact(class))
+			continue;
+		freed += zs_compact_class(pool, class, nr_pages - freed);
+	}
+
+	atomic_long_add(freed, &pool->pages_compacted);
+	return freed;
+}
+
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	return __zs_compact(pool, ULONG_MAX);
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+static unsigned long zs_compactable_pages(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages = 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		pages += zs_can_compact(class) * class->pages_per_zspage;
+	}
+
+	return pages;
+}
+
+static int zs_shrink(struct shrinker *shrinker, struct shrink_control *sc)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					shrinker);
+
+	if (sc->nr_to_scan)
+		__zs_compact(pool, sc->nr_to_scan);
+
+	return zs_compactable_pages(pool);
+}
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+u64 zs_get_compacted_pages(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->pages_compacted);
+}
+EXPORT_SYMBOL_GPL(zs_get_compacted_pages);
+
+static void zs_free_areas(struct zs_pool *pool)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		kfree(per_cpu_ptr(pool->area, cpu)->vm_buf);
+	free_percpu(pool->area);
+}
+
+/**
+ * zs_create_pool - create a pool of size-class zspages
+ * @flags: allocation flags used for zspage pages
+ *
+ * The pool registers a shrinker which compacts it under memory
+ * pressure.
+ */
+struct zs_pool *zs_create_pool(gfp_t flags)
+{
+	int i, cpu;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		int fg;
+
+		spin_lock_init(&class->lock);
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+					PAGE_SIZE / class->size;
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+	}
+
+	pool->area = alloc_percpu(struct mapping_area);
+	if (!pool->area) {
+		kfree(pool);
+		return NULL;
+	}
+
+	for_each_possible_cpu(cpu) {
+		char *buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+
+		if (!buf) {
+			zs_free_areas(pool);
+			kfree(pool);
+			return NULL;
+		}
+		per_cpu_ptr(pool->area, cpu)->vm_buf = buf;
+	}
+
+	pool->flags = flags;
+	pool->shrinker.shrink = zs_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+
+	unregister_shrinker(&pool->shrinker);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		int fg;
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			if (list_empty(&class->fullness_list[fg]))
+				continue;
+
+			pr_info("Freeing non-empty class with size %d, "
+				"fullness group %d\n", class->size, fg);
+		}
+	}
+
+	zs_free_areas(pool);
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+static int __init zs_init(void)
+{
+	zs_handle_cachep = KMEM_CACHE(zs_handle, 0);
+	zs_zspage_cachep = KMEM_CACHE(zspage, 0);
+	if (!zs_handle_cachep || !zs_zspage_cachep) {
+		if (zs_handle_cachep)
+			kmem_cache_destroy(zs_handle_cachep);
+		if (zs_zspage_cachep)
+			kmem_cache_destroy(zs_zspage_cachep);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void __exit zs_exit(void)
+{
+	kmem_cache_destroy(zs_zspage_cachep);
+	kmem_cache_destroy(zs_handle_cachep);
+}
+
+module_init(zs_init);
+module_exit(zs_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("zsmalloc memory allocator");
@@ -0,0 +1,119 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/* User configurable params */
+
+/*
+ * A zspage is a group of up to this many (not necessarily contiguous)
+ * 0-order pages which a size class treats as one linear area. Objects
+ * are packed back to back in that area and may straddle pages.
+ */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/*
+ * Size classes are separated by ZS_SIZE_CLASS_DELTA bytes. Every class
+ * size is a multiple of it, so object offsets are too and the handle
+ * stored at the start of an object never straddles a page.
+ */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+#define ZS_SIZE_CLASSES	((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) / \
+					ZS_SIZE_CLASS_DELTA + 1)
+
+#define ZS_MAX_OBJS_PER_ZSPAGE	(ZS_MAX_PAGES_PER_ZSPAGE * PAGE_SIZE / \
+					ZS_MIN_ALLOC_SIZE)
+
+/*
+ * A zspage is "almost empty" (a compaction source) while at most
+ * 3/4 of its objects are in use.
+ */
+#define ZS_FULLNESS_THRESHOLD_FRAC	4
+
+/* End of user params */
+
+/*
+ * Every object starts with a back-pointer to its handle so that
+ * compaction can find and update the handle when it moves the object.
+ */
+#define ZS_HANDLE_SIZE		sizeof(unsigned long)
+
+/* Bit in zs_handle.flags held while the object is mapped or moved */
+#define ZS_HANDLE_PIN_BIT	0
+
+enum fullness_group {
+	ZS_ALMOST_FULL,
+	ZS_ALMOST_EMPTY,
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY
+};
+
+struct size_class;
+
+struct zspage {
+	struct list_head list;		/* in class fullness list */
+	struct size_class *class;
+	unsigned int inuse;		/* no. of allocated objects */
+	enum fullness_group fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+	unsigned long used[BITS_TO_LONGS(ZS_MAX_OBJS_PER_ZSPAGE)];
+};
+
+/*
+ * Handles returned by zs_malloc() point to one of these. The object
+ * may move between zspages but the handle itself never does.
+ */
+struct zs_handle {
+	struct zspage *zspage;
+	unsigned int idx;		/* object index within zspage */
+	unsigned long flags;
+};
+
+struct size_class {
+	spinlock_t lock;
+	int size;			/* object size, including handle */
+	int pages_per_zspage;
+	int objs_per_zspage;
+	unsigned long zspages;		/* no. of zspages in this class */
+	unsigned long inuse;		/* no. of objects in this class */
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+};
+
+/* Per-cpu buffer used to map objects that straddle a page boundary */
+struct mapping_area {
+	char *vm_buf;
+	char *vm_addr;			/* kmap address, if not straddling */
+	enum zs_mapmode vm_mm;
+};
+
+struct zs_pool {
+	struct size_class size_class[ZS_SIZE_CLASSES];
+	struct mapping_area __percpu *area;
+	struct shrinker shrinker;
+	gfp_t flags;			/* allocation flags used for zspages */
+	atomic_long_t pages_allocated;	/* stats */
+	atomic_long_t pages_compacted;
+};
+
+#endif
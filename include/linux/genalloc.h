@@ -11,6 +11,12 @@
 
 #ifndef __GENALLOC_H__
 #define __GENALLOC_H__
+
+#include <linux/list.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
 /*
  *  General purpose special memory pool descriptor.
  */
@@ -18,6 +24,7 @@ struct gen_pool {
 	rwlock_t lock;
 	struct list_head chunks;	/* list of chunks in this pool */
 	int min_alloc_order;		/* minimum allocation order */
+	bool best_fit;			/* chunks keep free extent trees */
 };
 
 /*
@@ -29,10 +36,17 @@ struct gen_pool_chunk {
 	phys_addr_t phys_addr;		/* physical starting address of memory chunk */
 	unsigned long start_addr;	/* starting address of memory chunk */
 	unsigned long end_addr;		/* ending address of memory chunk */
+	struct rb_root free_by_addr;	/* best-fit: free extents by address */
+	struct rb_root free_by_size;	/* best-fit: free extents by size */
+	struct list_head spare_extents;	/* best-fit: unused extent structs */
+	struct list_head extent_blocks;	/* best-fit: memory of the extent structs */
+	unsigned long nr_extents;	/* best-fit: extent structs, used or spare */
+	unsigned long nr_allocs;	/* best-fit: outstanding allocations */
 	unsigned long bits[0];		/* bitmap for allocating memory chunk */
 };
 
 extern struct gen_pool *gen_pool_create(int, int);
+extern struct gen_pool *gen_pool_create_best_fit(int, int);
 extern phys_addr_t gen_pool_virt_to_phys(struct gen_pool *pool, unsigned long);
 extern int gen_pool_add_virt(struct gen_pool *, unsigned long, phys_addr_t,
 			     size_t, int);
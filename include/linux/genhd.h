@@ -155,6 +155,27 @@ struct disk_part_tbl {
 
 struct disk_events;
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+enum {
+	BLK_LAT_READ,
+	BLK_LAT_WRITE,
+	BLK_LAT_DISCARD,
+	BLK_LAT_FLUSH,
+	BLK_LAT_NR_OPS,
+};
+
+/*
+ * Bucket 0 counts requests that took under 1us, bucket n those that
+ * took [2^(n-1), 2^n) us, and the last bucket everything slower.
+ */
+#define BLK_LAT_BUCKETS		24
+
+struct disk_latency_hist {
+	unsigned long queue[BLK_LAT_NR_OPS][BLK_LAT_BUCKETS];
+	unsigned long device[BLK_LAT_NR_OPS][BLK_LAT_BUCKETS];
+};
+#endif
+
 struct gendisk {
 	/* major, first_minor and minors are input parameters only,
 	 * don't use directly.  Use disk_devt() and disk_max_parts().
@@ -193,6 +214,9 @@ struct gendisk {
 	struct blk_integrity *integrity;
 #endif
 	int node_id;
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	struct disk_latency_hist __percpu *latency_hist;
+#endif
 #ifdef CONFIG_USB_HOST_NOTIFY
 	int media_present;
 	int interfaces;
@@ -63,6 +63,7 @@ struct ion_buffer;
  * @name:	used for debug purposes
  * @base:	base address of heap in physical memory if applicable
  * @size:	size of the heap in bytes if applicable
+ * @flags:	ION_HEAP_FLAG_* for the heap
  *
  * Provided by the board file.
  */
@@ -72,8 +73,16 @@ struct ion_platform_heap {
 	const char *name;
 	ion_phys_addr_t base;
 	size_t size;
+	unsigned long flags;
 };
 
+/*
+ * Free the heap's buffers from a worker rather than in the context of the
+ * last ion_free() or close(), and keep freed buffers to hand out again to
+ * the next allocation of the same size and flags.
+ */
+#define ION_HEAP_FLAG_DEFER_FREE	(1 << 0)
+
 /**
  * struct ion_platform_data - array of platform heaps passed from board file
  * @nr:		number of structures in the array
@@ -42,6 +42,39 @@ enum oom_constraint {
 
 extern int test_set_oom_score_adj(int new_val);
 
+/*
+ * The Android lowmemorykiller keeps thread group leaders indexed by
+ * oom_adj. The index follows the process list, so these are called
+ * with tasklist_lock write-locked, except lowmem_task_adj_changed()
+ * and lowmem_task_exec() which take it themselves. Every writer of
+ * oom_adj or oom_score_adj must call lowmem_task_adj_changed().
+ */
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+extern void lowmem_task_add(struct task_struct *p);
+extern void lowmem_task_del(struct task_struct *p);
+extern void lowmem_task_replace(struct task_struct *old,
+				struct task_struct *new);
+extern void lowmem_task_adj_changed(struct task_struct *p);
+extern void lowmem_task_exec(struct task_struct *p);
+#else
+static inline void lowmem_task_add(struct task_struct *p)
+{
+}
+static inline void lowmem_task_del(struct task_struct *p)
+{
+}
+static inline void lowmem_task_replace(struct task_struct *old,
+				struct task_struct *new)
+{
+}
+static inline void lowmem_task_adj_changed(struct task_struct *p)
+{
+}
+static inline void lowmem_task_exec(struct task_struct *p)
+{
+}
+#endif
+
 extern unsigned int oom_badness(struct task_struct *p, struct mem_cgroup *mem,
 			const nodemask_t *nodemask, unsigned long totalpages);
 extern int try_set_zonelist_oom(struct zonelist *zonelist, gfp_t gfp_flags);
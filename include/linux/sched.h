@@ -1280,6 +1280,9 @@ struct task_struct {
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
 #endif
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	struct list_head lowmem_node;	/* in lowmemorykiller oom_adj bucket */
+#endif
 
 	struct mm_struct *mm, *active_mm;
 #ifdef CONFIG_COMPAT_BRK
@@ -1482,6 +1485,9 @@ struct task_struct {
 	u64 acct_vm_mem1;	/* accumulated virtual memory usage */
 	cputime_t acct_timexpd;	/* stime + utime since last update */
 #endif
+#ifdef CONFIG_READAHEAD_TRACE
+	unsigned int ra_trace_session;	/* see mm/readahead_trace.c */
+#endif
 #ifdef CONFIG_CPUSETS
 	nodemask_t mems_allowed;	/* Protected by alloc_lock */
 	int mems_allowed_change_disable;
@@ -2050,6 +2056,20 @@ extern struct task_struct *idle_task(int cpu);
 extern struct task_struct *curr_task(int cpu);
 extern void set_curr_task(int cpu, struct task_struct *p);
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Called with the runqueue lock held whenever a task wakes up on @cpu,
+ * @nr_running being the number of runnable tasks there including @p, and
+ * when a task switched in there raises the CPU's frequency boost. @boost
+ * is the cpu cgroup freq_boost of @p, in percent of the maximum speed.
+ */
+typedef void (*sched_cpufreq_event_fn)(int cpu, unsigned long nr_running,
+				       struct task_struct *p,
+				       unsigned int boost);
+extern void sched_set_cpufreq_event(sched_cpufreq_event_fn fn);
+extern unsigned int sched_cpu_freq_boost(int cpu);
+#endif
+
 void yield(void);
 
 /*
@@ -16,8 +16,11 @@
 #ifndef _LINUX_WAKELOCK_H
 #define _LINUX_WAKELOCK_H
 
+#include <linux/ioctl.h>
 #include <linux/list.h>
 #include <linux/ktime.h>
+#include <linux/rbtree.h>
+#include <linux/types.h>
 
 /* A wake_lock prevents the system from entering suspend or other low power
  * states when active. If the type is set to WAKE_LOCK_SUSPEND, the wake_lock
@@ -32,12 +35,34 @@ enum {
 	WAKE_LOCK_TYPE_COUNT
 };
 
+/* ioctls on /dev/wakelock, which takes user wake locks by id */
+
+#define WAKE_LOCK_NAME_LEN	64
+
+struct wake_lock_create {
+	char	name[WAKE_LOCK_NAME_LEN];	/* in: lock name */
+	__u32	id;				/* out: id to lock it by */
+};
+
+struct wake_lock_acquire {
+	__u64	timeout;	/* nanoseconds, or 0 for no timeout */
+	__u32	id;
+	__u32	reserved;
+};
+
+#define __WAKELOCKIOC		0xF5
+
+#define WAKE_LOCK_IOCTL_CREATE	_IOWR(__WAKELOCKIOC, 1, struct wake_lock_create)
+#define WAKE_LOCK_IOCTL_LOCK	_IOW(__WAKELOCKIOC, 2, struct wake_lock_acquire)
+#define WAKE_LOCK_IOCTL_UNLOCK	_IOW(__WAKELOCKIOC, 3, __u32)
+
 struct wake_lock {
 #ifdef CONFIG_HAS_WAKELOCK
 	struct list_head    link;
 	int                 flags;
 	const char         *name;
 	unsigned long       expires;
+	struct rb_node      expire_node;
 #ifdef CONFIG_WAKELOCK_STAT
 	struct {
 		int             count;
@@ -82,6 +82,27 @@ DEFINE_EVENT(loadeval, cpufreq_interactive_notyet,
 	    TP_ARGS(cpu_id, load, curfreq, targfreq)
 );
 
+TRACE_EVENT(cpufreq_interactive_sched,
+	    TP_PROTO(unsigned long cpu_id, unsigned long nr_running,
+		     int boost),
+	    TP_ARGS(cpu_id, nr_running, boost),
+
+	    TP_STRUCT__entry(
+		    __field(unsigned long, cpu_id     )
+		    __field(unsigned long, nr_running )
+		    __field(int,           boost      )
+	    ),
+
+	    TP_fast_assign(
+		    __entry->cpu_id = cpu_id;
+		    __entry->nr_running = nr_running;
+		    __entry->boost = boost;
+	    ),
+
+	    TP_printk("cpu=%lu nr_running=%lu boost=%d",
+		      __entry->cpu_id, __entry->nr_running, __entry->boost)
+);
+
 TRACE_EVENT(cpufreq_interactive_boost,
 	    TP_PROTO(const char *s),
 	    TP_ARGS(s),
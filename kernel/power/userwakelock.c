@@ -14,9 +14,18 @@
  */
 
 #include <linux/ctype.h>
+#include <linux/dcache.h>
+#include <linux/hash.h>
 #include <linux/module.h>
+#include <linux/rculist.h>
 #include <linux/wakelock.h>
 #include <linux/slab.h>
+#ifdef CONFIG_USER_WAKELOCK_DEV
+#include <linux/fs.h>
+#include <linux/idr.h>
+#include <linux/miscdevice.h>
+#include <linux/uaccess.h>
+#endif
 
 #include "power.h"
 
@@ -30,23 +39,100 @@ enum {
 static int debug_mask = DEBUG_FAILURE;
 module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 
-static DEFINE_MUTEX(tree_lock);
+/*
+ * User wake locks are never freed, so lookups only need rcu_read_lock() to
+ * walk a hash chain while a new lock is being added to it. hash_lock
+ * serializes adding locks.
+ */
+#define USER_WAKE_LOCK_HASH_BITS	6
+
+static DEFINE_MUTEX(hash_lock);
+static struct hlist_head user_wake_locks[1 << USER_WAKE_LOCK_HASH_BITS];
+#ifdef CONFIG_USER_WAKELOCK_DEV
+static DEFINE_IDR(user_wake_lock_idr);
+#endif
 
 struct user_wake_lock {
-	struct rb_node		node;
+	struct hlist_node	node;
+	unsigned int		hash;
+#ifdef CONFIG_USER_WAKELOCK_DEV
+	int			id;
+#endif
 	struct wake_lock	wake_lock;
 	char			name[0];
 };
-struct rb_root user_wake_locks;
+
+/* convert timeout from nanoseconds to jiffies > 0 */
+static long timeout_to_jiffies(u64 timeout)
+{
+	timeout += (NSEC_PER_SEC / HZ) - 1;
+	do_div(timeout, (NSEC_PER_SEC / HZ));
+	if (timeout <= 0)
+		timeout = 1;
+	return timeout;
+}
+
+static struct user_wake_lock *find_wake_lock(const char *name, int name_len,
+					     unsigned int hash)
+{
+	struct hlist_head *head;
+	struct hlist_node *pos;
+	struct user_wake_lock *l;
+
+	head = &user_wake_locks[hash_32(hash, USER_WAKE_LOCK_HASH_BITS)];
+	hlist_for_each_entry_rcu(l, pos, head, node) {
+		if (l->hash == hash && !strncmp(name, l->name, name_len) &&
+		    !l->name[name_len])
+			return l;
+	}
+	return NULL;
+}
+
+static struct user_wake_lock *new_wake_lock(const char *name, int name_len,
+					    unsigned int hash)
+{
+	struct user_wake_lock *l;
+
+	mutex_lock(&hash_lock);
+	/* someone else may have added it since the lockless lookup */
+	l = find_wake_lock(name, name_len, hash);
+	if (l)
+		goto out;
+
+	l = kzalloc(sizeof(*l) + name_len + 1, GFP_KERNEL);
+	if (l == NULL) {
+		if (debug_mask & DEBUG_FAILURE)
+			pr_err("lookup_wake_lock_name: failed to allocate "
+				"memory for %.*s\n", name_len, name);
+		l = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+	memcpy(l->name, name, name_len);
+	l->hash = hash;
+#ifdef CONFIG_USER_WAKELOCK_DEV
+	do {
+		if (!idr_pre_get(&user_wake_lock_idr, GFP_KERNEL)) {
+			kfree(l);
+			l = ERR_PTR(-ENOMEM);
+			goto out;
+		}
+	} while (idr_get_new(&user_wake_lock_idr, l, &l->id) == -EAGAIN);
+#endif
+	if (debug_mask & DEBUG_NEW)
+		pr_info("lookup_wake_lock_name: new wake lock %s\n", l->name);
+	wake_lock_init(&l->wake_lock, WAKE_LOCK_SUSPEND, l->name);
+	hlist_add_head_rcu(&l->node,
+		&user_wake_locks[hash_32(hash, USER_WAKE_LOCK_HASH_BITS)]);
+out:
+	mutex_unlock(&hash_lock);
+	return l;
+}
 
 static struct user_wake_lock *lookup_wake_lock_name(
 	const char *buf, int allocate, long *timeoutptr)
 {
-	struct rb_node **p = &user_wake_locks.rb_node;
-	struct rb_node *parent = NULL;
 	struct user_wake_lock *l;
-	int diff;
-	u64 timeout;
+	unsigned int hash;
 	int name_len;
 	const char *arg;
 
@@ -62,62 +148,33 @@ static struct user_wake_lock *lookup_wake_lock_name(
 
 	/* Process timeout string */
 	if (timeoutptr && *arg) {
-		timeout = simple_strtoull(arg, (char **)&arg, 0);
+		u64 timeout = simple_strtoull(arg, (char **)&arg, 0);
 		while (isspace(*arg))
 			arg++;
 		if (*arg)
 			goto bad_arg;
-		/* convert timeout from nanoseconds to jiffies > 0 */
-		timeout += (NSEC_PER_SEC / HZ) - 1;
-		do_div(timeout, (NSEC_PER_SEC / HZ));
-		if (timeout <= 0)
-			timeout = 1;
-		*timeoutptr = timeout;
+		*timeoutptr = timeout_to_jiffies(timeout);
 	} else if (*arg)
 		goto bad_arg;
 	else if (timeoutptr)
 		*timeoutptr = 0;
 
-	/* Lookup wake lock in rbtree */
-	while (*p) {
-		parent = *p;
-		l = rb_entry(parent, struct user_wake_lock, node);
-		diff = strncmp(buf, l->name, name_len);
-		if (!diff && l->name[name_len])
-			diff = -1;
-		if (debug_mask & DEBUG_ERROR)
-			pr_info("lookup_wake_lock_name: compare %.*s %s %d\n",
-				name_len, buf, l->name, diff);
-
-		if (diff < 0)
-			p = &(*p)->rb_left;
-		else if (diff > 0)
-			p = &(*p)->rb_right;
-		else
-			return l;
-	}
+	/* Lookup wake lock in hash table */
+	hash = full_name_hash(buf, name_len);
+	rcu_read_lock();
+	l = find_wake_lock(buf, name_len, hash);
+	rcu_read_unlock();
+	if (l)
+		return l;
 
-	/* Allocate and add new wakelock to rbtree */
+	/* Allocate and add new wakelock to hash table */
 	if (!allocate) {
 		if (debug_mask & DEBUG_ERROR)
 			pr_info("lookup_wake_lock_name: %.*s not found\n",
 				name_len, buf);
 		return ERR_PTR(-EINVAL);
 	}
-	l = kzalloc(sizeof(*l) + name_len + 1, GFP_KERNEL);
-	if (l == NULL) {
-		if (debug_mask & DEBUG_FAILURE)
-			pr_err("lookup_wake_lock_name: failed to allocate "
-				"memory for %.*s\n", name_len, buf);
-		return ERR_PTR(-ENOMEM);
-	}
-	memcpy(l->name, buf, name_len);
-	if (debug_mask & DEBUG_NEW)
-		pr_info("lookup_wake_lock_name: new wake lock %s\n", l->name);
-	wake_lock_init(&l->wake_lock, WAKE_LOCK_SUSPEND, l->name);
-	rb_link_node(&l->node, parent, p);
-	rb_insert_color(&l->node, &user_wake_locks);
-	return l;
+	return new_wake_lock(buf, name_len, hash);
 
 bad_arg:
 	if (debug_mask & DEBUG_ERROR)
@@ -131,19 +188,19 @@ ssize_t wake_lock_show(
 {
 	char *s = buf;
 	char *end = buf + PAGE_SIZE;
-	struct rb_node *n;
+	struct hlist_node *pos;
 	struct user_wake_lock *l;
+	int i;
 
-	mutex_lock(&tree_lock);
-
-	for (n = rb_first(&user_wake_locks); n != NULL; n = rb_next(n)) {
-		l = rb_entry(n, struct user_wake_lock, node);
-		if (wake_lock_active(&l->wake_lock))
-			s += scnprintf(s, end - s, "%s ", l->name);
+	rcu_read_lock();
+	for (i = 0; i < ARRAY_SIZE(user_wake_locks); i++) {
+		hlist_for_each_entry_rcu(l, pos, &user_wake_locks[i], node) {
+			if (wake_lock_active(&l->wake_lock))
+				s += scnprintf(s, end - s, "%s ", l->name);
+		}
 	}
 	s += scnprintf(s, end - s, "\n");
-
-	mutex_unlock(&tree_lock);
+	rcu_read_unlock();
 	return (s - buf);
 }
 
@@ -154,12 +211,9 @@ ssize_t wake_lock_store(
 	long timeout;
 	struct user_wake_lock *l;
 
-	mutex_lock(&tree_lock);
 	l = lookup_wake_lock_name(buf, 1, &timeout);
-	if (IS_ERR(l)) {
-		n = PTR_ERR(l);
-		goto bad_name;
-	}
+	if (IS_ERR(l))
+		return PTR_ERR(l);
 
 	if (debug_mask & DEBUG_ACCESS)
 		pr_info("wake_lock_store: %s, timeout %ld\n", l->name, timeout);
@@ -168,8 +222,6 @@ ssize_t wake_lock_store(
 		wake_lock_timeout(&l->wake_lock, timeout);
 	else
 		wake_lock(&l->wake_lock);
-bad_name:
-	mutex_unlock(&tree_lock);
 	return n;
 }
 
@@ -179,19 +231,19 @@ ssize_t wake_unlock_show(
 {
 	char *s = buf;
 	char *end = buf + PAGE_SIZE;
-	struct rb_node *n;
+	struct hlist_node *pos;
 	struct user_wake_lock *l;
+	int i;
 
-	mutex_lock(&tree_lock);
-
-	for (n = rb_first(&user_wake_locks); n != NULL; n = rb_next(n)) {
-		l = rb_entry(n, struct user_wake_lock, node);
-		if (!wake_lock_active(&l->wake_lock))
-			s += scnprintf(s, end - s, "%s ", l->name);
+	rcu_read_lock();
+	for (i = 0; i < ARRAY_SIZE(user_wake_locks); i++) {
+		hlist_for_each_entry_rcu(l, pos, &user_wake_locks[i], node) {
+			if (!wake_lock_active(&l->wake_lock))
+				s += scnprintf(s, end - s, "%s ", l->name);
+		}
 	}
 	s += scnprintf(s, end - s, "\n");
-
-	mutex_unlock(&tree_lock);
+	rcu_read_unlock();
 	return (s - buf);
 }
 
@@ -201,19 +253,103 @@ ssize_t wake_unlock_store(
 {
 	struct user_wake_lock *l;
 
-	mutex_lock(&tree_lock);
 	l = lookup_wake_lock_name(buf, 0, NULL);
-	if (IS_ERR(l)) {
-		n = PTR_ERR(l);
-		goto not_found;
-	}
+	if (IS_ERR(l))
+		return PTR_ERR(l);
 
 	if (debug_mask & DEBUG_ACCESS)
 		pr_info("wake_unlock_store: %s\n", l->name);
 
 	wake_unlock(&l->wake_lock);
-not_found:
-	mutex_unlock(&tree_lock);
 	return n;
 }
 
+#ifdef CONFIG_USER_WAKELOCK_DEV
+/*
+ * /dev/wakelock takes the same locks by the id handed out when they are
+ * created, so that taking and releasing one parses no string and hashes no
+ * name.
+ */
+static struct user_wake_lock *lookup_wake_lock_id(u32 id)
+{
+	struct user_wake_lock *l;
+
+	rcu_read_lock();
+	l = idr_find(&user_wake_lock_idr, id);
+	rcu_read_unlock();
+	if (!l && (debug_mask & DEBUG_ERROR))
+		pr_info("lookup_wake_lock_id: %u not found\n", id);
+	return l;
+}
+
+static long user_wake_lock_ioctl(struct file *file, unsigned int cmd,
+				 unsigned long arg)
+{
+	void __user *argp = (void __user *)arg;
+	struct wake_lock_create create;
+	struct wake_lock_acquire acquire;
+	struct user_wake_lock *l;
+	u32 id;
+
+	switch (cmd) {
+	case WAKE_LOCK_IOCTL_CREATE:
+		if (copy_from_user(&create, argp, sizeof(create)))
+			return -EFAULT;
+		create.name[sizeof(create.name) - 1] = '\0';
+		l = lookup_wake_lock_name(create.name, 1, NULL);
+		if (IS_ERR(l))
+			return PTR_ERR(l);
+		create.id = l->id;
+		if (copy_to_user(argp, &create, sizeof(create)))
+			return -EFAULT;
+		return 0;
+
+	case WAKE_LOCK_IOCTL_LOCK:
+		if (copy_from_user(&acquire, argp, sizeof(acquire)))
+			return -EFAULT;
+		l = lookup_wake_lock_id(acquire.id);
+		if (!l)
+			return -EINVAL;
+		if (debug_mask & DEBUG_ACCESS)
+			pr_info("user_wake_lock_ioctl: lock %s, timeout %llu\n",
+				l->name, acquire.timeout);
+		if (acquire.timeout)
+			wake_lock_timeout(&l->wake_lock,
+					  timeout_to_jiffies(acquire.timeout));
+		else
+			wake_lock(&l->wake_lock);
+		return 0;
+
+	case WAKE_LOCK_IOCTL_UNLOCK:
+		if (get_user(id, (u32 __user *)argp))
+			return -EFAULT;
+		l = lookup_wake_lock_id(id);
+		if (!l)
+			return -EINVAL;
+		if (debug_mask & DEBUG_ACCESS)
+			pr_info("user_wake_lock_ioctl: unlock %s\n", l->name);
+		wake_unlock(&l->wake_lock);
+		return 0;
+	}
+	return -ENOTTY;
+}
+
+static const struct file_operations user_wake_lock_fops = {
+	.owner = THIS_MODULE,
+	.unlocked_ioctl = user_wake_lock_ioctl,
+	.compat_ioctl = user_wake_lock_ioctl,
+};
+
+static struct miscdevice user_wake_lock_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "wakelock",
+	.fops = &user_wake_lock_fops,
+};
+
+static int __init user_wake_lock_dev_init(void)
+{
+	return misc_register(&user_wake_lock_dev);
+}
+device_initcall(user_wake_lock_dev_init);
+#endif
+
@@ -43,6 +43,20 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+
+/*
+ * Active locks with a timeout are also kept in a tree sorted by expiry, with
+ * the earliest and the latest one cached, and active locks without a timeout
+ * are only counted. has_wake_lock_locked() then never walks the lists above,
+ * which are left for the stats and debug output.
+ */
+struct wake_lock_expiry {
+	struct rb_root tree;
+	struct rb_node *first;
+	struct rb_node *last;
+	atomic_t no_timeout;
+};
+static struct wake_lock_expiry lock_expiry[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 struct workqueue_struct *suspend_work_queue;
 struct wake_lock main_wake_lock;
@@ -60,6 +74,17 @@ static struct wake_lock deleted_wake_locks;
 static ktime_t last_sleep_time_update;
 static int wait_for_wakeup;
 
+/*
+ * A lock flagged WAKE_LOCK_PREVENTING_SUSPEND has been doing so since it was
+ * locked or since the main lock was last released, whichever came later.
+ */
+static ktime_t prevent_suspend_start(struct wake_lock *lock)
+{
+	if (lock->stat.last_time.tv64 > last_sleep_time_update.tv64)
+		return lock->stat.last_time;
+	return last_sleep_time_update;
+}
+
 int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 {
 	struct timespec ts;
@@ -106,7 +131,7 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 		total_time = ktime_add(total_time, add_time);
 		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND)
 			prevent_suspend_time = ktime_add(prevent_suspend_time,
-					ktime_sub(now, last_sleep_time_update));
+					ktime_sub(now, prevent_suspend_start(lock)));
 		if (add_time.tv64 > max_time.tv64)
 			max_time = add_time;
 	}
@@ -158,30 +183,32 @@ static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 	lock->stat.total_time = ktime_add(lock->stat.total_time, duration);
 	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
 		lock->stat.max_time = duration;
-	lock->stat.last_time = ktime_get();
 	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-		duration = ktime_sub(now, last_sleep_time_update);
+		duration = ktime_sub(now, prevent_suspend_start(lock));
 		lock->stat.prevent_suspend_time = ktime_add(
 			lock->stat.prevent_suspend_time, duration);
 		lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
 	}
+	lock->stat.last_time = ktime_get();
 }
 
+/*
+ * Called when the main lock is taken (done) or released. Locks are only
+ * credited with the time they prevented suspend here and when they are
+ * unlocked, so taking other locks while waiting to sleep stays O(1).
+ */
 static void update_sleep_wait_stats_locked(int done)
 {
 	struct wake_lock *lock;
-	ktime_t now, etime, elapsed, add;
+	ktime_t now, etime, add;
 	int expired;
 
 	now = ktime_get();
-	elapsed = ktime_sub(now, last_sleep_time_update);
 	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link) {
 		expired = get_expired_time(lock, &etime);
 		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-			if (expired)
-				add = ktime_sub(etime, last_sleep_time_update);
-			else
-				add = elapsed;
+			add = ktime_sub(expired ? etime : now,
+					prevent_suspend_start(lock));
 			lock->stat.prevent_suspend_time = ktime_add(
 				lock->stat.prevent_suspend_time, add);
 		}
@@ -194,12 +221,63 @@ static void update_sleep_wait_stats_locked(int done)
 }
 #endif
 
+/* Caller must acquire the list_lock spinlock */
+static void lock_expiry_insert(struct wake_lock *lock, int type)
+{
+	struct wake_lock_expiry *e = &lock_expiry[type];
+	struct rb_node **p = &e->tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct wake_lock *entry;
+	bool leftmost = true, rightmost = true;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct wake_lock, expire_node);
+		if (time_before(lock->expires, entry->expires)) {
+			p = &parent->rb_left;
+			rightmost = false;
+		} else {
+			p = &parent->rb_right;
+			leftmost = false;
+		}
+	}
+	rb_link_node(&lock->expire_node, parent, p);
+	rb_insert_color(&lock->expire_node, &e->tree);
+	if (leftmost)
+		e->first = &lock->expire_node;
+	if (rightmost)
+		e->last = &lock->expire_node;
+}
+
+/*
+ * Drop an active lock from the expiry tree or the count of locks without a
+ * timeout, before its flags change. Caller must acquire the list_lock.
+ */
+static void lock_expiry_remove(struct wake_lock *lock)
+{
+	struct wake_lock_expiry *e;
+
+	if (!(lock->flags & WAKE_LOCK_ACTIVE))
+		return;
+	e = &lock_expiry[lock->flags & WAKE_LOCK_TYPE_MASK];
+	if (!(lock->flags & WAKE_LOCK_AUTO_EXPIRE)) {
+		atomic_dec(&e->no_timeout);
+		return;
+	}
+	if (e->first == &lock->expire_node)
+		e->first = rb_next(&lock->expire_node);
+	if (e->last == &lock->expire_node)
+		e->last = rb_prev(&lock->expire_node);
+	rb_erase(&lock->expire_node, &e->tree);
+}
+
 
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
 #endif
+	lock_expiry_remove(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -232,27 +310,39 @@ static void print_active_locks(int type)
 
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct wake_lock_expiry *e = &lock_expiry[type];
+	struct wake_lock *lock;
+	unsigned long now = jiffies;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
+	if (atomic_read(&e->no_timeout))
+		return -1;
+	while (e->first) {
+		lock = rb_entry(e->first, struct wake_lock, expire_node);
+		if (time_after(lock->expires, now))
+			break;
+		expire_wake_lock(lock);
 	}
-	return max_timeout;
+	if (!e->last)
+		return 0;
+	lock = rb_entry(e->last, struct wake_lock, expire_node);
+	return lock->expires - now;
 }
 
 long has_wake_lock(int type)
 {
 	long ret;
 	unsigned long irqflags;
+
+	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
+	/*
+	 * With a lock held that has no timeout there is nothing to expire, so
+	 * answer without list_lock unless the active locks are to be printed.
+	 */
+	if (atomic_read(&lock_expiry[type].no_timeout) &&
+	    !((debug_mask & DEBUG_WAKEUP) && type == WAKE_LOCK_SUSPEND))
+		return -1;
+
 	spin_lock_irqsave(&list_lock, irqflags);
 	ret = has_wake_lock_locked(type);
 	if (ret && (debug_mask & DEBUG_WAKEUP) && type == WAKE_LOCK_SUSPEND)
@@ -379,6 +469,7 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->flags = (type & WAKE_LOCK_TYPE_MASK) | WAKE_LOCK_INITIALIZED;
 
 	INIT_LIST_HEAD(&lock->link);
+	RB_CLEAR_NODE(&lock->expire_node);
 	spin_lock_irqsave(&list_lock, irqflags);
 	list_add(&lock->link, &inactive_locks);
 	spin_unlock_irqrestore(&list_lock, irqflags);
@@ -391,7 +482,9 @@ void wake_lock_destroy(struct wake_lock *lock)
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_lock_destroy name=%s\n", lock->name);
 	spin_lock_irqsave(&list_lock, irqflags);
-	lock->flags &= ~WAKE_LOCK_INITIALIZED;
+	lock_expiry_remove(lock);
+	lock->flags &= ~(WAKE_LOCK_INITIALIZED | WAKE_LOCK_ACTIVE |
+			 WAKE_LOCK_AUTO_EXPIRE);
 #ifdef CONFIG_WAKELOCK_STAT
 	if (lock->stat.count) {
 		deleted_wake_locks.stat.count += lock->stat.count;
@@ -423,6 +516,7 @@ static void wake_lock_internal(
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
 	BUG_ON(!(lock->flags & WAKE_LOCK_INITIALIZED));
+	lock_expiry_remove(lock);
 #ifdef CONFIG_WAKELOCK_STAT
 	if (type == WAKE_LOCK_SUSPEND && wait_for_wakeup) {
 		if (debug_mask & DEBUG_WAKEUP)
@@ -451,12 +545,14 @@ static void wake_lock_internal(
 		lock->expires = jiffies + timeout;
 		lock->flags |= WAKE_LOCK_AUTO_EXPIRE;
 		list_add_tail(&lock->link, &active_wake_locks[type]);
+		lock_expiry_insert(lock, type);
 	} else {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d\n", lock->name, type);
 		lock->expires = LONG_MAX;
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
 		list_add(&lock->link, &active_wake_locks[type]);
+		atomic_inc(&lock_expiry[type].no_timeout);
 	}
 	if (type == WAKE_LOCK_SUSPEND) {
 		current_event_num++;
@@ -464,7 +560,7 @@ static void wake_lock_internal(
 		if (lock == &main_wake_lock)
 			update_sleep_wait_stats_locked(1);
 		else if (!wake_lock_active(&main_wake_lock))
-			update_sleep_wait_stats_locked(0);
+			lock->flags |= WAKE_LOCK_PREVENTING_SUSPEND;
 #endif
 		if (has_timeout)
 			expire_in = has_wake_lock_locked(type);
@@ -510,6 +606,7 @@ void wake_unlock(struct wake_lock *lock)
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
+	lock_expiry_remove(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -564,8 +661,10 @@ static int __init wakelocks_init(void)
 	int ret;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
+	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++) {
 		INIT_LIST_HEAD(&active_wake_locks[i]);
+		lock_expiry[i].tree = RB_ROOT;
+	}
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
@@ -276,6 +276,11 @@ struct task_group {
 #ifdef CONFIG_SCHED_AUTOGROUP
 	struct autogroup *autogroup;
 #endif
+
+#ifdef CONFIG_CPU_FREQ
+	/* speed floor while the group's tasks run, in percent of max */
+	unsigned int freq_boost;
+#endif
 };
 
 /* task_group_lock serializes the addition/removal of task groups */
@@ -564,6 +569,12 @@ struct rq {
 #ifdef CONFIG_SMP
 	struct task_struct *wake_list;
 #endif
+
+#ifdef CONFIG_CPU_FREQ
+	/* highest freq_boost runnable here since cpufreq last asked */
+	unsigned int freq_boost;
+	unsigned int curr_freq_boost;
+#endif
 };
 
 static DEFINE_PER_CPU_SHARED_ALIGNED(struct rq, runqueues);
@@ -2027,6 +2038,83 @@ static void update_rq_clock_task(struct rq *rq, s64 delta)
 
 #endif /* CONFIG_IRQ_TIME_ACCOUNTING */
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * A cpufreq governor can ask to hear about wakeups, to raise the speed of
+ * a CPU that just got busier without waiting for its next load sample.
+ * The hook runs under the rq lock, so it must not wake tasks itself.
+ */
+static sched_cpufreq_event_fn cpufreq_event_fn __read_mostly;
+
+void sched_set_cpufreq_event(sched_cpufreq_event_fn fn)
+{
+	cpufreq_event_fn = fn;
+	/* wait for wakeups still calling the old hook */
+	synchronize_sched();
+}
+EXPORT_SYMBOL_GPL(sched_set_cpufreq_event);
+
+/*
+ * Return the highest freq_boost of the tasks that woke up or ran on @cpu
+ * since the last call, and start over from the task running there now.
+ * Only tracked while a hook is set with sched_set_cpufreq_event().
+ */
+unsigned int sched_cpu_freq_boost(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+
+	return xchg(&rq->freq_boost, ACCESS_ONCE(rq->curr_freq_boost));
+}
+EXPORT_SYMBOL_GPL(sched_cpu_freq_boost);
+
+static inline unsigned int task_freq_boost(struct task_struct *p)
+{
+#ifdef CONFIG_CGROUP_SCHED
+	return task_group(p)->freq_boost;
+#else
+	return 0;
+#endif
+}
+
+/* Called from enqueue_task, before nr_running is increased */
+static inline void
+cpufreq_event_enqueue(struct rq *rq, struct task_struct *p, int flags)
+{
+	sched_cpufreq_event_fn fn = ACCESS_ONCE(cpufreq_event_fn);
+	unsigned int boost;
+
+	/* without a governor listening, skip the cgroup lookup */
+	if (!fn || !(flags & ENQUEUE_WAKEUP))
+		return;
+	boost = task_freq_boost(p);
+	if (boost > rq->freq_boost)
+		rq->freq_boost = boost;
+	fn(cpu_of(rq), rq->nr_running + 1, p, boost);
+}
+
+/* Called under the rq lock when @next is about to run */
+static inline void cpufreq_event_switch(struct rq *rq, struct task_struct *next)
+{
+	sched_cpufreq_event_fn fn = ACCESS_ONCE(cpufreq_event_fn);
+	unsigned int boost;
+
+	/* this runs on every context switch; most of the time, nobody asked */
+	if (!fn)
+		return;
+	boost = task_freq_boost(next);
+	rq->curr_freq_boost = boost;
+	if (boost <= rq->freq_boost)
+		return;
+	rq->freq_boost = boost;
+	fn(cpu_of(rq), rq->nr_running, next, boost);
+}
+#else
+static inline void
+cpufreq_event_enqueue(struct rq *rq, struct task_struct *p, int flags) { }
+static inline void
+cpufreq_event_switch(struct rq *rq, struct task_struct *next) { }
+#endif
+
 #include "sched_idletask.c"
 #include "sched_fair.c"
 #include "sched_rt.c"
@@ -3038,6 +3126,7 @@ prepare_task_switch(struct rq *rq, struct task_struct *prev,
 		    struct task_struct *next)
 {
 	sched_info_switch(prev, next);
+	cpufreq_event_switch(rq, next);
 	perf_event_task_sched_out(prev, next);
 	fire_sched_out_preempt_notifiers(prev, next);
 	prepare_lock_switch(rq, next);
@@ -9034,6 +9123,24 @@ static u64 cpu_shares_read_u64(struct cgroup *cgrp, struct cftype *cft)
 }
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
+#ifdef CONFIG_CPU_FREQ
+static int cpu_freq_boost_write_u64(struct cgroup *cgrp, struct cftype *cftype,
+				    u64 boost)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+
+	if (tg == &root_task_group || boost > 100)
+		return -EINVAL;
+	tg->freq_boost = boost;
+	return 0;
+}
+
+static u64 cpu_freq_boost_read_u64(struct cgroup *cgrp, struct cftype *cft)
+{
+	return cgroup_tg(cgrp)->freq_boost;
+}
+#endif /* CONFIG_CPU_FREQ */
+
 #ifdef CONFIG_RT_GROUP_SCHED
 static int cpu_rt_runtime_write(struct cgroup *cgrp, struct cftype *cft,
 				s64 val)
@@ -9066,6 +9173,13 @@ static struct cftype cpu_files[] = {
 		.write_u64 = cpu_shares_write_u64,
 	},
 #endif
+#ifdef CONFIG_CPU_FREQ
+	{
+		.name = "freq_boost",
+		.read_u64 = cpu_freq_boost_read_u64,
+		.write_u64 = cpu_freq_boost_write_u64,
+	},
+#endif
 #ifdef CONFIG_RT_GROUP_SCHED
 	{
 		.name = "rt_runtime_us",
@@ -1327,6 +1327,8 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+	cpufreq_event_enqueue(rq, p, flags);
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
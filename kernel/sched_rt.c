@@ -942,6 +942,8 @@ enqueue_task_rt(struct rq *rq, struct task_struct *p, int flags)
 {
 	struct sched_rt_entity *rt_se = &p->rt;
 
+	cpufreq_event_enqueue(rq, p, flags);
+
 	if (flags & ENQUEUE_WAKEUP)
 		rt_se->timeout = 0;
 
@@ -15,6 +15,185 @@
 #include <linux/bitmap.h>
 #include <linux/genalloc.h>
 
+/*
+ * Best-fit pools keep the free space of each chunk as extents in two
+ * rbtrees instead of a bitmap: one ordered by address, used to coalesce
+ * neighbours on free, and one ordered by size, used to find the smallest
+ * extent that fits. Both allocation and free are O(log n) in the number
+ * of free extents, rather than a scan of the whole chunk.
+ *
+ * A chunk never has more free extents than allocations plus one. Extent
+ * structs are carved out of page sized blocks, and allocation keeps at
+ * least that many on the chunk, so gen_pool_free() never needs memory.
+ * New blocks are only needed when the number of allocations reaches a
+ * new high, once per EXTENTS_PER_BLOCK of them, so neither allocation
+ * nor free normally touches the slab allocator.
+ */
+struct gen_pool_extent {
+	struct rb_node addr_node;
+	union {
+		struct rb_node size_node;	/* while free */
+		struct list_head spare;		/* while on spare_extents */
+	};
+	unsigned long start;
+	unsigned long size;
+};
+
+struct gen_pool_extent_block {
+	struct list_head list;		/* on chunk->extent_blocks */
+	struct gen_pool_extent ext[0];
+};
+
+#define EXTENTS_PER_BLOCK \
+	((PAGE_SIZE - sizeof(struct gen_pool_extent_block)) / \
+	 sizeof(struct gen_pool_extent))
+
+/* Add a block of spare extent structs to the chunk */
+static int extent_grow(struct gen_pool_chunk *chunk, gfp_t gfp, int nid)
+{
+	struct gen_pool_extent_block *block;
+	unsigned long flags;
+	int i;
+
+	block = kmalloc_node(PAGE_SIZE, gfp, nid);
+	if (unlikely(block == NULL))
+		return -ENOMEM;
+
+	spin_lock_irqsave(&chunk->lock, flags);
+	list_add(&block->list, &chunk->extent_blocks);
+	for (i = 0; i < EXTENTS_PER_BLOCK; i++)
+		list_add(&block->ext[i].spare, &chunk->spare_extents);
+	chunk->nr_extents += EXTENTS_PER_BLOCK;
+	spin_unlock_irqrestore(&chunk->lock, flags);
+	return 0;
+}
+
+static void extent_insert_addr(struct gen_pool_chunk *chunk,
+			       struct gen_pool_extent *ext)
+{
+	struct rb_node **p = &chunk->free_by_addr.rb_node;
+	struct rb_node *parent = NULL;
+	struct gen_pool_extent *entry;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct gen_pool_extent, addr_node);
+		if (ext->start < entry->start)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&ext->addr_node, parent, p);
+	rb_insert_color(&ext->addr_node, &chunk->free_by_addr);
+}
+
+static void extent_insert_size(struct gen_pool_chunk *chunk,
+			       struct gen_pool_extent *ext)
+{
+	struct rb_node **p = &chunk->free_by_size.rb_node;
+	struct rb_node *parent = NULL;
+	struct gen_pool_extent *entry;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct gen_pool_extent, size_node);
+		if (ext->size < entry->size ||
+		    (ext->size == entry->size && ext->start < entry->start))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&ext->size_node, parent, p);
+	rb_insert_color(&ext->size_node, &chunk->free_by_size);
+}
+
+/*
+ * Carve 'size' bytes out of the smallest free extent that holds them.
+ * Returns the address, or 0 if no extent is large enough. Caller holds
+ * chunk->lock.
+ */
+static unsigned long extent_alloc(struct gen_pool_chunk *chunk,
+				  unsigned long size)
+{
+	struct rb_node *n = chunk->free_by_size.rb_node;
+	struct gen_pool_extent *ext, *best = NULL;
+	unsigned long addr;
+
+	while (n) {
+		ext = rb_entry(n, struct gen_pool_extent, size_node);
+		if (ext->size < size) {
+			n = n->rb_right;
+		} else {
+			best = ext;
+			n = n->rb_left;
+		}
+	}
+	if (!best)
+		return 0;
+
+	addr = best->start;
+	rb_erase(&best->size_node, &chunk->free_by_size);
+	if (best->size == size) {
+		rb_erase(&best->addr_node, &chunk->free_by_addr);
+		list_add(&best->spare, &chunk->spare_extents);
+	} else {
+		/* keeps its place in the address tree */
+		best->start += size;
+		best->size -= size;
+		extent_insert_size(chunk, best);
+	}
+	return addr;
+}
+
+/*
+ * Return [addr, addr + size) to the chunk, merging it with the free
+ * extents on either side. Caller holds chunk->lock.
+ */
+static void extent_free(struct gen_pool_chunk *chunk, unsigned long addr,
+			unsigned long size)
+{
+	struct rb_node *n = chunk->free_by_addr.rb_node;
+	struct gen_pool_extent *ext, *prev = NULL, *next = NULL;
+
+	while (n) {
+		ext = rb_entry(n, struct gen_pool_extent, addr_node);
+		if (addr < ext->start) {
+			next = ext;
+			n = n->rb_left;
+		} else {
+			prev = ext;
+			n = n->rb_right;
+		}
+	}
+	BUG_ON(prev && prev->start + prev->size > addr);
+	BUG_ON(next && addr + size > next->start);
+
+	if (prev && prev->start + prev->size == addr) {
+		rb_erase(&prev->size_node, &chunk->free_by_size);
+		prev->size += size;
+		if (next && next->start == addr + size) {
+			rb_erase(&next->size_node, &chunk->free_by_size);
+			rb_erase(&next->addr_node, &chunk->free_by_addr);
+			prev->size += next->size;
+			list_add(&next->spare, &chunk->spare_extents);
+		}
+		extent_insert_size(chunk, prev);
+	} else if (next && next->start == addr + size) {
+		rb_erase(&next->size_node, &chunk->free_by_size);
+		next->start = addr;
+		next->size += size;
+		extent_insert_size(chunk, next);
+	} else {
+		BUG_ON(list_empty(&chunk->spare_extents));
+		ext = list_first_entry(&chunk->spare_extents,
+				       struct gen_pool_extent, spare);
+		list_del(&ext->spare);
+		ext->start = addr;
+		ext->size = size;
+		extent_insert_addr(chunk, ext);
+		extent_insert_size(chunk, ext);
+	}
+}
 
 /**
  * gen_pool_create - create a new special memory pool
@@ -33,11 +212,33 @@ struct gen_pool *gen_pool_create(int min_alloc_order, int nid)
 		rwlock_init(&pool->lock);
 		INIT_LIST_HEAD(&pool->chunks);
 		pool->min_alloc_order = min_alloc_order;
+		pool->best_fit = false;
 	}
 	return pool;
 }
 EXPORT_SYMBOL(gen_pool_create);
 
+/**
+ * gen_pool_create_best_fit - create a new best-fit special memory pool
+ * @min_alloc_order: log base 2 of the allocation granularity in bytes
+ * @nid: node id of the node the pool structure should be allocated on, or -1
+ *
+ * Like gen_pool_create(), but the pool tracks free space as extents in
+ * trees and allocates from the smallest one that fits. Allocation and
+ * free cost O(log n) in the number of free extents instead of a scan of
+ * the chunk's bitmap, which suits large pools with fine granularity.
+ */
+struct gen_pool *gen_pool_create_best_fit(int min_alloc_order, int nid)
+{
+	struct gen_pool *pool;
+
+	pool = gen_pool_create(min_alloc_order, nid);
+	if (pool != NULL)
+		pool->best_fit = true;
+	return pool;
+}
+EXPORT_SYMBOL(gen_pool_create_best_fit);
+
 /**
  * gen_pool_add_virt - add a new chunk of special memory to the pool
  * @pool: pool to add new memory chunk to
@@ -55,10 +256,14 @@ int gen_pool_add_virt(struct gen_pool *pool, unsigned long virt, phys_addr_t phy
 		 size_t size, int nid)
 {
 	struct gen_pool_chunk *chunk;
+	struct gen_pool_extent *ext;
 	int nbits = size >> pool->min_alloc_order;
 	int nbytes = sizeof(struct gen_pool_chunk) +
 				(nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
 
+	if (pool->best_fit)
+		nbytes = sizeof(struct gen_pool_chunk);
+
 	chunk = kmalloc_node(nbytes, GFP_KERNEL | __GFP_ZERO, nid);
 	if (unlikely(chunk == NULL))
 		return -ENOMEM;
@@ -67,6 +272,24 @@ int gen_pool_add_virt(struct gen_pool *pool, unsigned long virt, phys_addr_t phy
 	chunk->phys_addr = phys;
 	chunk->start_addr = virt;
 	chunk->end_addr = virt + size;
+	chunk->free_by_addr = RB_ROOT;
+	chunk->free_by_size = RB_ROOT;
+	INIT_LIST_HEAD(&chunk->spare_extents);
+	INIT_LIST_HEAD(&chunk->extent_blocks);
+
+	if (pool->best_fit) {
+		if (extent_grow(chunk, GFP_KERNEL, nid)) {
+			kfree(chunk);
+			return -ENOMEM;
+		}
+		ext = list_first_entry(&chunk->spare_extents,
+				       struct gen_pool_extent, spare);
+		list_del(&ext->spare);
+		ext->start = virt;
+		ext->size = (unsigned long)nbits << pool->min_alloc_order;
+		extent_insert_addr(chunk, ext);
+		extent_insert_size(chunk, ext);
+	}
 
 	write_lock(&pool->lock);
 	list_add(&chunk->next_chunk, &pool->chunks);
@@ -121,8 +344,23 @@ void gen_pool_destroy(struct gen_pool *pool)
 		list_del(&chunk->next_chunk);
 
 		end_bit = (chunk->end_addr - chunk->start_addr) >> order;
-		bit = find_next_bit(chunk->bits, end_bit, 0);
-		BUG_ON(bit < end_bit);
+		if (pool->best_fit) {
+			struct gen_pool_extent_block *block, *next;
+			struct gen_pool_extent *ext;
+			struct rb_node *n = rb_first(&chunk->free_by_addr);
+
+			/* everything free means one extent covering it all */
+			BUG_ON(!n || rb_next(n));
+			ext = rb_entry(n, struct gen_pool_extent, addr_node);
+			BUG_ON(ext->size >> order != end_bit);
+			BUG_ON(chunk->nr_allocs);
+			list_for_each_entry_safe(block, next,
+						 &chunk->extent_blocks, list)
+				kfree(block);
+		} else {
+			bit = find_next_bit(chunk->bits, end_bit, 0);
+			BUG_ON(bit < end_bit);
+		}
 
 		kfree(chunk);
 	}
@@ -131,13 +369,45 @@ void gen_pool_destroy(struct gen_pool *pool)
 }
 EXPORT_SYMBOL(gen_pool_destroy);
 
+static unsigned long gen_pool_best_fit_alloc(struct gen_pool *pool,
+					     unsigned long size)
+{
+	struct gen_pool_chunk *chunk;
+	unsigned long addr = 0, flags;
+	bool grow;
+
+	read_lock(&pool->lock);
+	list_for_each_entry(chunk, &pool->chunks, next_chunk) {
+		do {
+			spin_lock_irqsave(&chunk->lock, flags);
+			/*
+			 * Freeing may need one extent struct per allocation
+			 * plus one, counting the one about to be made.
+			 */
+			grow = chunk->nr_extents < chunk->nr_allocs + 2;
+			if (!grow) {
+				addr = extent_alloc(chunk, size);
+				if (addr)
+					chunk->nr_allocs++;
+			}
+			spin_unlock_irqrestore(&chunk->lock, flags);
+		} while (grow && !extent_grow(chunk, GFP_ATOMIC, -1));
+		if (addr)
+			break;
+	}
+	read_unlock(&pool->lock);
+
+	return addr;
+}
+
 /**
  * gen_pool_alloc - allocate special memory from the pool
  * @pool: pool to allocate from
  * @size: number of bytes to allocate from the pool
  *
  * Allocate the requested number of bytes from the specified pool.
- * Uses a first-fit algorithm.
+ * Uses a first-fit algorithm, or best-fit for pools made with
+ * gen_pool_create_best_fit().
  */
 unsigned long gen_pool_alloc(struct gen_pool *pool, size_t size)
 {
@@ -152,6 +422,10 @@ unsigned long gen_pool_alloc(struct gen_pool *pool, size_t size)
 
 	nbits = (size + (1UL << order) - 1) >> order;
 
+	if (pool->best_fit)
+		return gen_pool_best_fit_alloc(pool,
+					       (unsigned long)nbits << order);
+
 	read_lock(&pool->lock);
 	list_for_each(_chunk, &pool->chunks) {
 		chunk = list_entry(_chunk, struct gen_pool_chunk, next_chunk);
@@ -202,6 +476,15 @@ void gen_pool_free(struct gen_pool *pool, unsigned long addr, size_t size)
 
 		if (addr >= chunk->start_addr && addr < chunk->end_addr) {
 			BUG_ON(addr + size > chunk->end_addr);
+			if (pool->best_fit) {
+				spin_lock_irqsave(&chunk->lock, flags);
+				extent_free(chunk, addr,
+					    (unsigned long)nbits << order);
+				chunk->nr_allocs--;
+				spin_unlock_irqrestore(&chunk->lock, flags);
+				nbits = 0;
+				break;
+			}
 			spin_lock_irqsave(&chunk->lock, flags);
 			bit = (addr - chunk->start_addr) >> order;
 			while (nbits--)
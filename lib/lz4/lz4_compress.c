@@ -0,0 +1,125 @@
+/*
+ *  LZ4 Compressor
+ *
+ *  Greedy single-pass compressor producing the LZ4 block format: a
+ *  sequence of (literal run, match) pairs, each introduced by a token
+ *  byte holding the run and match lengths, followed by a final run of
+ *  literals.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(u32 seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+	return op;
+}
+
+static inline unsigned char *lz4_put_literals(unsigned char *op,
+		unsigned char *token, const unsigned char *anchor, size_t run)
+{
+	if (run >= LZ4_RUN_MASK) {
+		*token = LZ4_RUN_MASK << LZ4_ML_BITS;
+		op = lz4_put_length(op, run - LZ4_RUN_MASK);
+	} else
+		*token = run << LZ4_ML_BITS;
+
+	memcpy(op, anchor, run);
+	return op + run;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *hash_table = wrkmem;
+	const unsigned char *ip = src;
+	const unsigned char *anchor = src;
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - LZ4_MFLIMIT;
+	const unsigned char * const matchlimit = iend - LZ4_LASTLITERALS;
+	unsigned char *op = dst;
+	unsigned char *token;
+
+	if (src_len < LZ4_MFLIMIT + 1)
+		goto last_literals;
+
+	memset(hash_table, 0, LZ4_MEM_COMPRESS);
+	hash_table[lz4_hash(get_unaligned((u32 *)ip))] = 0;
+	ip++;
+
+	while (ip <= mflimit) {
+		const unsigned char *ref;
+		size_t len;
+		u32 seq, h;
+
+		seq = get_unaligned((u32 *)ip);
+		h = lz4_hash(seq);
+		ref = src + hash_table[h];
+		hash_table[h] = ip - src;
+
+		if (ref >= ip || ip - ref > LZ4_MAX_DISTANCE ||
+		    get_unaligned((u32 *)ref) != seq) {
+			/* the longer we find nothing, the bigger the step */
+			ip += 1 + ((ip - anchor) >> LZ4_SKIP_STRENGTH);
+			continue;
+		}
+
+		/* extend the match backwards over pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		len = LZ4_MINMATCH;
+		while (ip + len < matchlimit && ip[len] == ref[len])
+			len++;
+
+		token = op++;
+		op = lz4_put_literals(op, token, anchor, ip - anchor);
+
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		if (len - LZ4_MINMATCH >= LZ4_ML_MASK) {
+			*token |= LZ4_ML_MASK;
+			op = lz4_put_length(op, len - LZ4_MINMATCH - LZ4_ML_MASK);
+		} else
+			*token |= len - LZ4_MINMATCH;
+
+		ip += len;
+		anchor = ip;
+
+		/* keep the table useful for the position just matched */
+		hash_table[lz4_hash(get_unaligned((u32 *)(ip - 2)))] =
+			ip - 2 - src;
+	}
+
+last_literals:
+	token = op++;
+	op = lz4_put_literals(op, token, anchor, iend - anchor);
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
@@ -0,0 +1,98 @@
+/*
+ *  LZ4 Decompressor
+ *
+ *  Decodes the LZ4 block format, checking every literal run and match
+ *  against the bounds of both the input and the output buffer.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/* Returns 0 if a length extension would run past the end of input */
+static inline int lz4_get_length(const unsigned char **ip,
+		const unsigned char *iend, size_t *len)
+{
+	unsigned int s;
+
+	do {
+		if (unlikely(*ip >= iend))
+			return 0;
+		s = *(*ip)++;
+		*len += s;
+	} while (s == 255);
+
+	return 1;
+}
+
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len)
+{
+	const unsigned char *ip = src;
+	const unsigned char * const iend = src + src_len;
+	unsigned char *op = dest;
+	unsigned char * const oend = dest + *dest_len;
+
+	while (ip < iend) {
+		const unsigned char *ref;
+		unsigned int token;
+		size_t len, offset;
+
+		token = *ip++;
+
+		/* literal run */
+		len = token >> LZ4_ML_BITS;
+		if (len == LZ4_RUN_MASK && !lz4_get_length(&ip, iend, &len))
+			return LZ4_E_INPUT_OVERRUN;
+		if (unlikely(len > (size_t)(iend - ip)))
+			return LZ4_E_INPUT_OVERRUN;
+		if (unlikely(len > (size_t)(oend - op)))
+			return LZ4_E_OUTPUT_OVERRUN;
+		memcpy(op, ip, len);
+		ip += len;
+		op += len;
+
+		/* the block ends with a run of literals */
+		if (ip == iend)
+			break;
+
+		/* match */
+		if (unlikely(iend - ip < 2))
+			return LZ4_E_INPUT_OVERRUN;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(offset == 0 || offset > (size_t)(op - dest)))
+			return LZ4_E_LOOKBEHIND_OVERRUN;
+		ref = op - offset;
+
+		len = token & LZ4_ML_MASK;
+		if (len == LZ4_ML_MASK && !lz4_get_length(&ip, iend, &len))
+			return LZ4_E_INPUT_OVERRUN;
+		len += LZ4_MINMATCH;
+		if (unlikely(len > (size_t)(oend - op)))
+			return LZ4_E_OUTPUT_OVERRUN;
+
+		if (offset >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		} else {
+			/* overlapping match repeats the last offset bytes */
+			while (len--)
+				*op++ = *ref++;
+		}
+	}
+
+	*dest_len = op - dest;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_decompress_unknownoutputsize);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
@@ -0,0 +1,25 @@
+/*
+ *  lz4defs.h -- common LZ4 block format definitions
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#define LZ4_MINMATCH		4
+
+/* The last match must start at least MFLIMIT bytes before the end */
+#define LZ4_MFLIMIT		12
+
+/* The last LASTLITERALS bytes are always encoded as literals */
+#define LZ4_LASTLITERALS	5
+
+#define LZ4_MAX_DISTANCE	0xffff
+
+#define LZ4_ML_BITS		4
+#define LZ4_ML_MASK		((1U << LZ4_ML_BITS) - 1)
+#define LZ4_RUN_BITS		(8 - LZ4_ML_BITS)
+#define LZ4_RUN_MASK		((1U << LZ4_RUN_BITS) - 1)
+
+/* Skip faster over incompressible data, see lz4_compress() */
+#define LZ4_SKIP_STRENGTH	6
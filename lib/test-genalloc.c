@@ -0,0 +1,188 @@
+/*
+ * Runs one random allocation workload against a first-fit (bitmap) and a
+ * best-fit (extent tree) gen_pool and reports how long alloc and free take
+ * and how fragmented each pool ends up.
+ *
+ * Every block handed out is also checked to lie inside the pool, to be
+ * aligned to the pool's granularity and not to overlap any live block.
+ * Once everything is freed, the whole pool must be allocatable again as
+ * one block.
+ */
+#include <linux/genalloc.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#define POOL_BASE	0x10000000UL
+#define POOL_SIZE	(256UL << 20)
+#define POOL_ORDER	12
+#define NR_SLOTS	512
+#define NR_STEPS	100000
+
+struct genalloc_result {
+	u64 alloc_ns, alloc_max_ns;
+	u64 free_ns, free_max_ns;
+	unsigned int allocs, frees, failures;
+	unsigned long largest_free;
+	unsigned int errors;
+};
+
+struct genalloc_slot {
+	unsigned long addr;
+	size_t size;
+};
+
+static u32 __init test_rand(u32 *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+/* Check a new block against the pool bounds and every live block */
+static void __init check_block(struct genalloc_slot *slots,
+			       struct genalloc_slot *new,
+			       struct genalloc_result *res)
+{
+	unsigned long end = new->addr + new->size;
+	int i;
+
+	if (new->addr < POOL_BASE || end > POOL_BASE + POOL_SIZE ||
+	    new->addr & ((1UL << POOL_ORDER) - 1)) {
+		pr_err("genalloc: block %#lx-%#lx outside pool or unaligned\n",
+		       new->addr, end);
+		res->errors++;
+	}
+
+	for (i = 0; i < NR_SLOTS; i++) {
+		struct genalloc_slot *slot = &slots[i];
+
+		if (slot == new || !slot->addr)
+			continue;
+		if (new->addr < slot->addr + slot->size &&
+		    slot->addr < end) {
+			pr_err("genalloc: block %#lx-%#lx overlaps "
+			       "%#lx-%#lx\n", new->addr, end, slot->addr,
+			       slot->addr + slot->size);
+			res->errors++;
+		}
+	}
+}
+
+/* Largest block the pool can still hand out, by bisection */
+static unsigned long __init largest_free(struct gen_pool *pool)
+{
+	unsigned long lo = 0, hi = POOL_SIZE >> POOL_ORDER, mid, addr;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		addr = gen_pool_alloc(pool, mid << POOL_ORDER);
+		if (addr) {
+			gen_pool_free(pool, addr, mid << POOL_ORDER);
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return lo << POOL_ORDER;
+}
+
+static int __init run_workload(struct gen_pool *pool,
+			       struct genalloc_slot *slots,
+			       struct genalloc_result *res)
+{
+	u32 seed = 1;
+	u64 t;
+	int i;
+
+	memset(slots, 0, NR_SLOTS * sizeof(*slots));
+	memset(res, 0, sizeof(*res));
+
+	if (gen_pool_add(pool, POOL_BASE, POOL_SIZE, -1))
+		return -ENOMEM;
+
+	for (i = 0; i < NR_STEPS; i++) {
+		struct genalloc_slot *slot = &slots[test_rand(&seed) % NR_SLOTS];
+
+		if (slot->addr) {
+			t = local_clock();
+			gen_pool_free(pool, slot->addr, slot->size);
+			t = local_clock() - t;
+			res->free_ns += t;
+			res->free_max_ns = max(res->free_max_ns, t);
+			res->frees++;
+			slot->addr = 0;
+			continue;
+		}
+
+		/* mostly small buffers, with the odd multi-megabyte one */
+		slot->size = (PAGE_SIZE << (test_rand(&seed) % 12)) +
+			     (test_rand(&seed) % 16) * PAGE_SIZE;
+		t = local_clock();
+		slot->addr = gen_pool_alloc(pool, slot->size);
+		t = local_clock() - t;
+		res->alloc_ns += t;
+		res->alloc_max_ns = max(res->alloc_max_ns, t);
+		if (slot->addr) {
+			res->allocs++;
+			check_block(slots, slot, res);
+		} else {
+			res->failures++;
+		}
+	}
+
+	res->largest_free = largest_free(pool);
+
+	for (i = 0; i < NR_SLOTS; i++)
+		if (slots[i].addr)
+			gen_pool_free(pool, slots[i].addr, slots[i].size);
+
+	if (largest_free(pool) != POOL_SIZE) {
+		pr_err("genalloc: pool not whole again after freeing "
+		       "everything\n");
+		res->errors++;
+	}
+	return 0;
+}
+
+static void __init report(const char *name, struct genalloc_result *res)
+{
+	pr_info("genalloc %s: %u allocs %u failed, avg %llu ns max %llu ns; "
+		"%u frees, avg %llu ns max %llu ns; largest free %lu KB; "
+		"%u errors\n",
+		name, res->allocs, res->failures,
+		div_u64(res->alloc_ns, max(res->allocs + res->failures, 1U)),
+		res->alloc_max_ns, res->frees,
+		div_u64(res->free_ns, max(res->frees, 1U)),
+		res->free_max_ns, res->largest_free >> 10, res->errors);
+}
+
+static int __init test_genalloc_init(void)
+{
+	struct genalloc_slot *slots;
+	struct genalloc_result res;
+	struct gen_pool *pool;
+
+	slots = kmalloc(NR_SLOTS * sizeof(*slots), GFP_KERNEL);
+	if (!slots)
+		return -ENOMEM;
+
+	pool = gen_pool_create(POOL_ORDER, -1);
+	if (pool && !run_workload(pool, slots, &res))
+		report("first-fit", &res);
+	if (pool)
+		gen_pool_destroy(pool);
+
+	pool = gen_pool_create_best_fit(POOL_ORDER, -1);
+	if (pool && !run_workload(pool, slots, &res))
+		report("best-fit", &res);
+	if (pool)
+		gen_pool_destroy(pool);
+
+	kfree(slots);
+	/* nothing to keep loaded */
+	return -EINVAL;
+}
+module_init(test_genalloc_init);
+MODULE_LICENSE("GPL");
@@ -295,6 +295,25 @@ static inline void mminit_validate_memmodel_limits(unsigned long *start_pfn,
 }
 #endif /* CONFIG_SPARSEMEM */
 
+#ifdef CONFIG_READAHEAD_TRACE
+extern unsigned int ra_trace_session;
+extern void __ra_trace_record(struct file *filp, pgoff_t index,
+			      unsigned long nr, unsigned long nr_read);
+
+/* Note pages read in on behalf of current, see mm/readahead_trace.c */
+static inline void ra_trace_record(struct file *filp, pgoff_t index,
+				   unsigned long nr, unsigned long nr_read)
+{
+	if (unlikely(ra_trace_session) && filp)
+		__ra_trace_record(filp, index, nr, nr_read);
+}
+#else
+static inline void ra_trace_record(struct file *filp, pgoff_t index,
+				   unsigned long nr, unsigned long nr_read)
+{
+}
+#endif
+
 #define ZONE_RECLAIM_NOSCAN	-2
 #define ZONE_RECLAIM_FULL	-1
 #define ZONE_RECLAIM_SOME	0
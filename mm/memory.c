@@ -57,6 +57,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/debugfs.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -3148,6 +3149,109 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+/*
+ * Map a page cache page that is uptodate and locked by the caller
+ * read-only at @address. Used by ->map_pages(); the caller holds the
+ * pte lock, has checked that *@pte is none, and passes its page
+ * reference on to the new mapping.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+	page_add_file_rmap(page);
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, pte);
+}
+
+/*
+ * Size of the window, aligned to its own size, that a read fault on a
+ * file mapping tries to populate from the page cache in one go. Must be
+ * a power of two; a single page turns fault-around off.
+ */
+static unsigned long fault_around_bytes __read_mostly = 65536;
+
+#ifdef CONFIG_DEBUG_FS
+static int fault_around_bytes_get(void *data, u64 *val)
+{
+	*val = fault_around_bytes;
+	return 0;
+}
+
+static int fault_around_bytes_set(void *data, u64 val)
+{
+	if (val / PAGE_SIZE > PTRS_PER_PTE)
+		return -EINVAL;
+	if (val > PAGE_SIZE)
+		fault_around_bytes = rounddown_pow_of_two(val);
+	else
+		fault_around_bytes = PAGE_SIZE;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(fault_around_bytes_fops,
+		fault_around_bytes_get, fault_around_bytes_set, "%llu\n");
+
+static int __init fault_around_debugfs(void)
+{
+	void *ret;
+
+	ret = debugfs_create_file("fault_around_bytes", 0644, NULL, NULL,
+			&fault_around_bytes_fops);
+	if (!ret)
+		pr_warning("Failed to create fault_around_bytes in debugfs");
+	return 0;
+}
+late_initcall(fault_around_debugfs);
+#endif
+
+/*
+ * do_fault_around() lets the vma's ->map_pages() map whatever pages
+ * around @address are already uptodate in the page cache, all under a
+ * single pte lock, so that touching them later does not fault again.
+ *
+ * The window is fault_around_bytes aligned down to its own size and
+ * clipped to the vma and to the page table that maps @address.
+ *
+ * Returns 1 if the pte for @address itself got mapped, in which case
+ * the fault has been handled.
+ */
+static int do_fault_around(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pmd_t *pmd, pgoff_t pgoff,
+		unsigned int flags, pte_t orig_pte)
+{
+	unsigned long window = ACCESS_ONCE(fault_around_bytes);
+	unsigned long start_addr, end_addr;
+	struct vm_fault vmf;
+	spinlock_t *ptl;
+	pte_t *pte;
+	int ret;
+
+	start_addr = max3(address & ~(window - 1), address & PMD_MASK,
+			  vma->vm_start);
+	end_addr = min((address & ~(window - 1)) + window,
+		       pmd_addr_end(address, vma->vm_end));
+
+	pte = pte_offset_map_lock(mm, pmd, start_addr, &ptl);
+
+	vmf.virtual_address = (void __user *)start_addr;
+	vmf.pgoff = pgoff - ((address - start_addr) >> PAGE_SHIFT);
+	vmf.max_pgoff = vmf.pgoff + ((end_addr - start_addr) >> PAGE_SHIFT) - 1;
+	vmf.flags = flags;
+	vmf.page = NULL;
+	vmf.pte = pte;
+	vma->vm_ops->map_pages(vma, &vmf);
+
+	ret = !pte_same(pte[(address - start_addr) >> PAGE_SHIFT], orig_pte);
+	pte_unmap_unlock(pte, ptl);
+	return ret;
+}
+
 /*
  * __do_fault() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -3342,6 +3446,17 @@ static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
 
 	pte_unmap(page_table);
+
+	/*
+	 * Read faults on file pages usually come in runs (binaries, dex
+	 * files, resources): map the cached neighbours while we are here.
+	 */
+	if (!(flags & FAULT_FLAG_WRITE) && vma->vm_ops->map_pages &&
+	    fault_around_bytes > PAGE_SIZE &&
+	    do_fault_around(mm, vma, address & PAGE_MASK, pmd, pgoff, flags,
+			    orig_pte))
+		return 0;
+
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
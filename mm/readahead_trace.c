@@ -0,0 +1,785 @@
+/*
+ * mm/readahead_trace.c - record page cache misses, replay them as readahead
+ *
+ * Boot and app launch read the same scattered file ranges every time, in
+ * an order the sequential readahead heuristics cannot predict. While a
+ * recording session is active, every range that has to be read in for a
+ * traced task is noted as (file, page offset, length). The trace can be
+ * read back from /proc/readahead/trace and, on a later run, written to the
+ * same file ahead of the workload: its ranges are then sorted, merged and
+ * read in the background with force_page_cache_readahead().
+ *
+ * See Documentation/vm/readahead-trace.txt for the interface.
+ */
+
+#include <linux/dcache.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/hash.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+
+#include "internal.h"
+
+#define RA_TRACE_HASH_BITS	6
+#define RA_TRACE_MAX_RANGES	65536	/* per session, over all files */
+#define RA_TRACE_LINE_RANGES	64	/* ranges per line of the trace */
+#define RA_TRACE_LINE_MAX	(PATH_MAX + RA_TRACE_LINE_RANGES * 24)
+#define RA_REPLAY_ACCOUNT_DELAY	(60 * HZ)	/* after a replay finishes */
+
+struct ra_trace_range {
+	pgoff_t index;
+	unsigned long nr;
+};
+
+/* A file read by the current or last recording session */
+struct ra_trace_file {
+	struct list_head list;		/* in ra_trace_files, first miss first */
+	struct hlist_node hash;		/* in ra_trace_hash while recording */
+	struct inode *inode;		/* pinned while recording */
+	char *path;
+	unsigned int nr_ranges;
+	unsigned int max_ranges;
+	struct ra_trace_range *ranges;
+};
+
+/* A line of a trace written back for replay */
+struct ra_replay_file {
+	struct list_head list;		/* in ra_replay_pending, then _done */
+	struct file *filp;		/* NULL if it could not be opened */
+	char *path;
+	unsigned int nr_ranges;
+	struct ra_trace_range ranges[];
+};
+
+/* Partial line carried between writes to /proc/readahead/trace */
+struct ra_replay_buf {
+	size_t len;
+	char data[RA_TRACE_LINE_MAX + 1];
+};
+
+unsigned int ra_trace_session;		/* non-zero while recording */
+static bool ra_trace_all;		/* boot session: trace every task */
+static pid_t ra_trace_pid;
+static unsigned int ra_trace_last_session;
+
+/* Recording state and session stats, protected by ra_trace_mutex */
+static DEFINE_MUTEX(ra_trace_mutex);
+static LIST_HEAD(ra_trace_files);
+static struct hlist_head ra_trace_hash[1 << RA_TRACE_HASH_BITS];
+static unsigned long ra_trace_start_time, ra_trace_stop_time;
+static unsigned long ra_trace_nr_files, ra_trace_nr_ranges;
+static unsigned long ra_trace_nr_pages, ra_trace_dropped;
+static unsigned int ra_trace_full_session;	/* ran out of ranges */
+
+static void ra_trace_stop_workfn(struct work_struct *work);
+static DECLARE_WORK(ra_trace_stop_work, ra_trace_stop_workfn);
+
+/* Replay state and stats, protected by ra_replay_mutex */
+static DEFINE_MUTEX(ra_replay_mutex);
+static LIST_HEAD(ra_replay_pending);
+static LIST_HEAD(ra_replay_done);
+static unsigned long ra_replay_files, ra_replay_failed, ra_replay_bad;
+static unsigned long ra_replay_pages, ra_replay_read, ra_replay_used;
+
+static void ra_replay_workfn(struct work_struct *work);
+static DECLARE_WORK(ra_replay_work, ra_replay_workfn);
+static void ra_replay_account_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(ra_replay_account_work, ra_replay_account_workfn);
+
+static int ra_range_cmp(const void *a, const void *b)
+{
+	const struct ra_trace_range *ra = a, *rb = b;
+
+	if (ra->index == rb->index)
+		return 0;
+	return ra->index < rb->index ? -1 : 1;
+}
+
+/*
+ * Sort ranges by offset and merge the ones that overlap or touch, so
+ * that each is read by a single readahead call. Returns the new count.
+ */
+static unsigned int ra_trace_merge(struct ra_trace_range *r, unsigned int nr)
+{
+	unsigned int i, n = 0;
+
+	if (!nr)
+		return 0;
+
+	sort(r, nr, sizeof(*r), ra_range_cmp, NULL);
+	for (i = 1; i < nr; i++) {
+		if (r[i].index <= r[n].index + r[n].nr)
+			r[n].nr = max(r[n].nr, r[i].index + r[i].nr - r[n].index);
+		else
+			r[++n] = r[i];
+	}
+	return n + 1;
+}
+
+static bool ra_trace_traced(void)
+{
+	if (!ra_trace_session || (current->flags & PF_KTHREAD))
+		return false;
+	return ra_trace_all || current->ra_trace_session == ra_trace_session;
+}
+
+static struct hlist_head *ra_trace_bucket(struct inode *inode)
+{
+	return &ra_trace_hash[hash_ptr(inode, RA_TRACE_HASH_BITS)];
+}
+
+static struct ra_trace_file *ra_trace_lookup(struct inode *inode)
+{
+	struct ra_trace_file *tf;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(tf, node, ra_trace_bucket(inode), hash)
+		if (tf->inode == inode)
+			return tf;
+	return NULL;
+}
+
+static struct ra_trace_file *ra_trace_add(struct file *filp)
+{
+	struct inode *inode = filp->f_mapping->host;
+	struct ra_trace_file *tf = NULL;
+	char *buf, *path;
+
+	/* Replay opens files by name, so only named regular files count */
+	if (!S_ISREG(filp->f_path.dentry->d_inode->i_mode) ||
+	    d_unlinked(filp->f_path.dentry))
+		return NULL;
+
+	buf = kmalloc(PATH_MAX, GFP_NOFS);
+	if (!buf)
+		return NULL;
+	path = d_path(&filp->f_path, buf, PATH_MAX);
+	if (IS_ERR(path) || strchr(path, '\n'))
+		goto out;
+
+	tf = kzalloc(sizeof(*tf), GFP_NOFS);
+	if (!tf)
+		goto out;
+	tf->path = kstrdup(path, GFP_NOFS);
+	tf->inode = igrab(inode);
+	if (!tf->path || !tf->inode) {
+		if (tf->inode)
+			iput(tf->inode);
+		kfree(tf->path);
+		kfree(tf);
+		tf = NULL;
+		goto out;
+	}
+
+	hlist_add_head(&tf->hash, ra_trace_bucket(inode));
+	list_add_tail(&tf->list, &ra_trace_files);
+	ra_trace_nr_files++;
+out:
+	kfree(buf);
+	return tf;
+}
+
+static int ra_trace_grow(struct ra_trace_file *tf)
+{
+	unsigned int max = tf->max_ranges ? tf->max_ranges * 2 : 8;
+	struct ra_trace_range *ranges;
+
+	ranges = krealloc(tf->ranges, max * sizeof(*ranges), GFP_NOFS);
+	if (!ranges)
+		return -ENOMEM;
+	tf->ranges = ranges;
+	tf->max_ranges = max;
+	return 0;
+}
+
+/*
+ * The session can take no more ranges. Stopping it here, in the middle of
+ * a page cache miss, would mean dropping inode references, so leave that
+ * to a work item. Caller holds ra_trace_mutex.
+ */
+static void ra_trace_full(void)
+{
+	ra_trace_dropped++;
+	if (ra_trace_full_session != ra_trace_session) {
+		ra_trace_full_session = ra_trace_session;
+		schedule_work(&ra_trace_stop_work);
+	}
+}
+
+/*
+ * Called from the readahead paths after @nr_read of the @nr pages from
+ * @index were found missing and submitted for I/O.
+ */
+void __ra_trace_record(struct file *filp, pgoff_t index, unsigned long nr,
+		       unsigned long nr_read)
+{
+	struct ra_trace_file *tf;
+	struct ra_trace_range *r;
+
+	if (!ra_trace_traced())
+		return;
+
+	mutex_lock(&ra_trace_mutex);
+	if (!ra_trace_traced())
+		goto out;
+
+	tf = ra_trace_lookup(filp->f_mapping->host);
+	if (!tf) {
+		/* a new file needs a range too, so don't even set it up */
+		if (ra_trace_nr_ranges >= RA_TRACE_MAX_RANGES) {
+			ra_trace_full();
+			goto out;
+		}
+		tf = ra_trace_add(filp);
+	}
+	if (!tf)
+		goto out;
+	ra_trace_nr_pages += nr_read;
+
+	/* Runs of sequential misses are by far the common case */
+	r = tf->nr_ranges ? &tf->ranges[tf->nr_ranges - 1] : NULL;
+	if (r && index >= r->index && index <= r->index + r->nr) {
+		r->nr = max(r->nr, index + nr - r->index);
+		goto out;
+	}
+
+	if (ra_trace_nr_ranges >= RA_TRACE_MAX_RANGES) {
+		ra_trace_full();
+		goto out;
+	}
+	if (tf->nr_ranges == tf->max_ranges && ra_trace_grow(tf)) {
+		ra_trace_dropped++;
+		goto out;
+	}
+	r = &tf->ranges[tf->nr_ranges++];
+	r->index = index;
+	r->nr = nr;
+	ra_trace_nr_ranges++;
+out:
+	mutex_unlock(&ra_trace_mutex);
+}
+
+/* Drop the recorded trace. Caller holds ra_trace_mutex, not recording. */
+static void ra_trace_free(void)
+{
+	struct ra_trace_file *tf, *next;
+
+	list_for_each_entry_safe(tf, next, &ra_trace_files, list) {
+		list_del(&tf->list);
+		kfree(tf->ranges);
+		kfree(tf->path);
+		kfree(tf);
+	}
+	ra_trace_nr_files = 0;
+	ra_trace_nr_ranges = 0;
+	ra_trace_nr_pages = 0;
+	ra_trace_dropped = 0;
+}
+
+/* Pages of a replayed file's ranges that have been touched since */
+static unsigned long ra_replay_count_used(struct ra_replay_file *rf)
+{
+	struct address_space *mapping = rf->filp->f_mapping;
+	struct page *pages[PAGEVEC_SIZE];
+	unsigned long used = 0;
+	unsigned int i, j, nr;
+
+	for (i = 0; i < rf->nr_ranges; i++) {
+		pgoff_t index = rf->ranges[i].index;
+		pgoff_t end = index + rf->ranges[i].nr;
+
+		while (index < end) {
+			nr = find_get_pages(mapping, index,
+					    min_t(pgoff_t, PAGEVEC_SIZE,
+						  end - index), pages);
+			if (!nr)
+				break;
+			for (j = 0; j < nr; j++) {
+				struct page *page = pages[j];
+
+				if (page->index < end &&
+				    (PageReferenced(page) || page_mapped(page)))
+					used++;
+				index = page->index + 1;
+				page_cache_release(page);
+			}
+		}
+		cond_resched();
+	}
+	return used;
+}
+
+static void ra_replay_free(struct ra_replay_file *rf)
+{
+	if (rf->filp)
+		fput(rf->filp);
+	kfree(rf->path);
+	kfree(rf);
+}
+
+/*
+ * Work out how much of the replayed data has been used since, and let go
+ * of the replayed files. Runs RA_REPLAY_ACCOUNT_DELAY after the last
+ * replay finished, or earlier when a session is stopped or cleared.
+ */
+static void ra_replay_account(void)
+{
+	struct ra_replay_file *rf, *next;
+	unsigned long used = 0;
+	LIST_HEAD(done);
+
+	mutex_lock(&ra_replay_mutex);
+	list_splice_init(&ra_replay_done, &done);
+	mutex_unlock(&ra_replay_mutex);
+
+	list_for_each_entry_safe(rf, next, &done, list) {
+		if (rf->filp)
+			used += ra_replay_count_used(rf);
+		ra_replay_free(rf);
+	}
+
+	mutex_lock(&ra_replay_mutex);
+	ra_replay_used += used;
+	mutex_unlock(&ra_replay_mutex);
+}
+
+static void ra_replay_account_workfn(struct work_struct *work)
+{
+	ra_replay_account();
+}
+
+/* Caller holds ra_trace_mutex */
+static void ra_trace_stop(void)
+{
+	struct ra_trace_file *tf;
+
+	if (!ra_trace_session)
+		return;
+	ra_trace_session = 0;
+	ra_trace_stop_time = jiffies;
+
+	ra_trace_nr_ranges = 0;
+	list_for_each_entry(tf, &ra_trace_files, list) {
+		hlist_del(&tf->hash);
+		iput(tf->inode);
+		tf->inode = NULL;
+		tf->nr_ranges = ra_trace_merge(tf->ranges, tf->nr_ranges);
+		ra_trace_nr_ranges += tf->nr_ranges;
+	}
+
+	ra_replay_account();
+}
+
+static void ra_trace_stop_workfn(struct work_struct *work)
+{
+	mutex_lock(&ra_trace_mutex);
+	if (ra_trace_session && ra_trace_session == ra_trace_full_session)
+		ra_trace_stop();
+	mutex_unlock(&ra_trace_mutex);
+}
+
+/*
+ * Start a session tracing @pid's thread group and everything it forks
+ * from now on, or every user task if @pid is 0. Caller holds
+ * ra_trace_mutex, or is early boot code.
+ */
+static int ra_trace_start(pid_t pid)
+{
+	unsigned int session = ra_trace_last_session + 1;
+	struct task_struct *p, *t;
+
+	if (!session)
+		session = 1;
+
+	if (pid) {
+		rcu_read_lock();
+		p = find_task_by_vpid(pid);
+		if (!p) {
+			rcu_read_unlock();
+			return -ESRCH;
+		}
+		t = p;
+		do {
+			t->ra_trace_session = session;
+		} while_each_thread(p, t);
+		rcu_read_unlock();
+	}
+
+	ra_trace_stop();
+	ra_trace_free();
+	ra_trace_last_session = session;
+	ra_trace_all = !pid;
+	ra_trace_pid = pid;
+	ra_trace_start_time = jiffies;
+	ra_trace_stop_time = 0;
+	smp_wmb();
+	ra_trace_session = session;
+	return 0;
+}
+
+static int __init ra_trace_setup(char *str)
+{
+	if (!strcmp(str, "boot"))
+		ra_trace_start(0);
+	return 1;
+}
+__setup("readahead_trace=", ra_trace_setup);
+
+static void ra_replay_one(struct ra_replay_file *rf)
+{
+	unsigned long pages = 0, read = 0;
+	struct file *filp;
+	unsigned int i;
+	int ret;
+
+	filp = filp_open(rf->path, O_RDONLY | O_LARGEFILE, 0);
+	if (IS_ERR(filp)) {
+		mutex_lock(&ra_replay_mutex);
+		ra_replay_failed++;
+		mutex_unlock(&ra_replay_mutex);
+		return;
+	}
+	rf->filp = filp;
+
+	for (i = 0; i < rf->nr_ranges; i++) {
+		ret = force_page_cache_readahead(filp->f_mapping, filp,
+				rf->ranges[i].index, rf->ranges[i].nr);
+		if (ret < 0)
+			break;
+		pages += rf->ranges[i].nr;
+		read += ret;
+	}
+
+	mutex_lock(&ra_replay_mutex);
+	ra_replay_files++;
+	ra_replay_pages += pages;
+	ra_replay_read += read;
+	mutex_unlock(&ra_replay_mutex);
+}
+
+static void ra_replay_workfn(struct work_struct *work)
+{
+	struct ra_replay_file *rf;
+
+	for (;;) {
+		mutex_lock(&ra_replay_mutex);
+		if (list_empty(&ra_replay_pending)) {
+			mutex_unlock(&ra_replay_mutex);
+			break;
+		}
+		rf = list_first_entry(&ra_replay_pending,
+				      struct ra_replay_file, list);
+		list_del(&rf->list);
+		mutex_unlock(&ra_replay_mutex);
+
+		ra_replay_one(rf);
+
+		mutex_lock(&ra_replay_mutex);
+		list_add_tail(&rf->list, &ra_replay_done);
+		mutex_unlock(&ra_replay_mutex);
+		cond_resched();
+	}
+
+	/*
+	 * Give the workload time to use what was read, then count how much
+	 * it did and release the files. Each replay pushes this back.
+	 */
+	cancel_delayed_work(&ra_replay_account_work);
+	queue_delayed_work(system_unbound_wq, &ra_replay_account_work,
+			   RA_REPLAY_ACCOUNT_DELAY);
+}
+
+/* Parse one "index:nr[,index:nr...] path" line and queue it for replay */
+static int ra_replay_parse(char *line)
+{
+	struct ra_replay_file *rf;
+	unsigned int nr = 1, i;
+	char *path, *p, *end;
+
+	if (!*line || *line == '#')
+		return 0;
+	path = strchr(line, ' ');
+	if (!path || !path[1])
+		return -EINVAL;
+	*path++ = '\0';
+	for (p = line; *p; p++)
+		if (*p == ',')
+			nr++;
+
+	rf = kmalloc(sizeof(*rf) + nr * sizeof(rf->ranges[0]), GFP_KERNEL);
+	if (!rf)
+		return -ENOMEM;
+	rf->filp = NULL;
+	rf->path = kstrdup(path, GFP_KERNEL);
+	if (!rf->path)
+		goto err;
+
+	for (i = 0, p = line; i < nr; i++, p = end + 1) {
+		rf->ranges[i].index = simple_strtoul(p, &end, 10);
+		if (end == p || *end != ':')
+			goto err;
+		p = end + 1;
+		rf->ranges[i].nr = simple_strtoul(p, &end, 10);
+		if (end == p || !rf->ranges[i].nr ||
+		    *end != (i == nr - 1 ? '\0' : ','))
+			goto err;
+	}
+	rf->nr_ranges = ra_trace_merge(rf->ranges, nr);
+
+	mutex_lock(&ra_replay_mutex);
+	list_add_tail(&rf->list, &ra_replay_pending);
+	mutex_unlock(&ra_replay_mutex);
+	return 0;
+err:
+	kfree(rf->path);
+	kfree(rf);
+	return -EINVAL;
+}
+
+/* Queue every complete line in @buf, and the partial one too if @flush */
+static void ra_replay_consume(struct ra_replay_buf *buf, bool flush)
+{
+	char *line = buf->data, *nl;
+	unsigned long bad = 0;
+
+	buf->data[buf->len] = '\0';
+	while ((nl = strchr(line, '\n')) || (flush && *line)) {
+		if (nl)
+			*nl = '\0';
+		if (ra_replay_parse(line))
+			bad++;
+		line = nl ? nl + 1 : line + strlen(line);
+	}
+	buf->len -= line - buf->data;
+	memmove(buf->data, line, buf->len);
+
+	if (bad) {
+		mutex_lock(&ra_replay_mutex);
+		ra_replay_bad += bad;
+		mutex_unlock(&ra_replay_mutex);
+	}
+}
+
+static void *ra_trace_seq_start(struct seq_file *m, loff_t *pos)
+{
+	mutex_lock(&ra_trace_mutex);
+	return seq_list_start(&ra_trace_files, *pos);
+}
+
+static void *ra_trace_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	return seq_list_next(v, &ra_trace_files, pos);
+}
+
+static void ra_trace_seq_stop(struct seq_file *m, void *v)
+{
+	mutex_unlock(&ra_trace_mutex);
+}
+
+static int ra_trace_seq_show(struct seq_file *m, void *v)
+{
+	struct ra_trace_file *tf = list_entry(v, struct ra_trace_file, list);
+	unsigned int i;
+
+	for (i = 0; i < tf->nr_ranges; i++) {
+		seq_printf(m, "%s%lu:%lu", i % RA_TRACE_LINE_RANGES ? "," : "",
+			   tf->ranges[i].index, tf->ranges[i].nr);
+		if (i % RA_TRACE_LINE_RANGES == RA_TRACE_LINE_RANGES - 1 ||
+		    i == tf->nr_ranges - 1)
+			seq_printf(m, " %s\n", tf->path);
+	}
+	return 0;
+}
+
+static const struct seq_operations ra_trace_seq_ops = {
+	.start	= ra_trace_seq_start,
+	.next	= ra_trace_seq_next,
+	.stop	= ra_trace_seq_stop,
+	.show	= ra_trace_seq_show,
+};
+
+/* Reads return the last recorded trace, writes replay one */
+static int ra_trace_open(struct inode *inode, struct file *file)
+{
+	struct ra_replay_buf *buf;
+
+	if ((file->f_mode & FMODE_READ) && (file->f_mode & FMODE_WRITE))
+		return -EINVAL;
+	if (file->f_mode & FMODE_READ)
+		return seq_open(file, &ra_trace_seq_ops);
+
+	buf = kmalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	buf->len = 0;
+	file->private_data = buf;
+	return 0;
+}
+
+static ssize_t ra_trace_write(struct file *file, const char __user *ubuf,
+			      size_t count, loff_t *ppos)
+{
+	struct ra_replay_buf *buf = file->private_data;
+	size_t done = 0, n;
+
+	while (done < count) {
+		n = min_t(size_t, count - done, RA_TRACE_LINE_MAX - buf->len);
+		if (!n)
+			return done ? done : -EINVAL;	/* line too long */
+		if (copy_from_user(buf->data + buf->len, ubuf + done, n))
+			return done ? done : -EFAULT;
+		buf->len += n;
+		done += n;
+		ra_replay_consume(buf, false);
+	}
+
+	queue_work(system_unbound_wq, &ra_replay_work);
+	return done;
+}
+
+static int ra_trace_release(struct inode *inode, struct file *file)
+{
+	struct ra_replay_buf *buf = file->private_data;
+
+	if (file->f_mode & FMODE_READ)
+		return seq_release(inode, file);
+
+	ra_replay_consume(buf, true);
+	kfree(buf);
+	queue_work(system_unbound_wq, &ra_replay_work);
+	return 0;
+}
+
+static const struct file_operations ra_trace_fops = {
+	.open		= ra_trace_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.write		= ra_trace_write,
+	.release	= ra_trace_release,
+};
+
+/*
+ * "boot" traces every user task, a pid traces that process and what it
+ * forks, "stop" ends the session and "clear" also drops the trace.
+ */
+static ssize_t ra_record_write(struct file *file, const char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	char cmd[16];
+	int pid, ret = 0;
+
+	if (count >= sizeof(cmd))
+		return -EINVAL;
+	if (copy_from_user(cmd, ubuf, count))
+		return -EFAULT;
+	cmd[count] = '\0';
+	strim(cmd);
+
+	mutex_lock(&ra_trace_mutex);
+	if (!strcmp(cmd, "stop"))
+		ra_trace_stop();
+	else if (!strcmp(cmd, "clear")) {
+		ra_trace_stop();
+		ra_trace_free();
+		ra_replay_account();
+	} else if (!strcmp(cmd, "boot"))
+		ret = ra_trace_start(0);
+	else if (!kstrtoint(cmd, 10, &pid) && pid > 0)
+		ret = ra_trace_start(pid);
+	else
+		ret = -EINVAL;
+	mutex_unlock(&ra_trace_mutex);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations ra_record_fops = {
+	.write		= ra_record_write,
+	.llseek		= noop_llseek,
+};
+
+static int ra_stats_show(struct seq_file *m, void *v)
+{
+	unsigned long end;
+
+	mutex_lock(&ra_trace_mutex);
+	if (!ra_trace_session)
+		seq_printf(m, "recording\tno\n");
+	else if (ra_trace_all)
+		seq_printf(m, "recording\tboot\n");
+	else
+		seq_printf(m, "recording\tpid %d\n", ra_trace_pid);
+	end = ra_trace_session ? jiffies : ra_trace_stop_time;
+	seq_printf(m, "session_ms\t%u\n", ra_trace_start_time ?
+		   jiffies_to_msecs(end - ra_trace_start_time) : 0);
+	seq_printf(m, "demand_files\t%lu\n", ra_trace_nr_files);
+	seq_printf(m, "demand_ranges\t%lu\n", ra_trace_nr_ranges);
+	seq_printf(m, "demand_pages\t%lu\n", ra_trace_nr_pages);
+	seq_printf(m, "dropped_ranges\t%lu\n", ra_trace_dropped);
+	mutex_unlock(&ra_trace_mutex);
+
+	mutex_lock(&ra_replay_mutex);
+	seq_printf(m, "replay_files\t%lu\n", ra_replay_files);
+	seq_printf(m, "replay_failed\t%lu\n", ra_replay_failed);
+	seq_printf(m, "replay_bad_lines\t%lu\n", ra_replay_bad);
+	seq_printf(m, "replay_pages\t%lu\n", ra_replay_pages);
+	seq_printf(m, "replay_read_pages\t%lu\n", ra_replay_read);
+	seq_printf(m, "replay_used_pages\t%lu\n", ra_replay_used);
+	seq_printf(m, "saved_kb\t%lu\n",
+		   min(ra_replay_read, ra_replay_used) << (PAGE_SHIFT - 10));
+	mutex_unlock(&ra_replay_mutex);
+	return 0;
+}
+
+static int ra_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ra_stats_show, NULL);
+}
+
+/* Writing anything resets the replay counters */
+static ssize_t ra_stats_write(struct file *file, const char __user *ubuf,
+			      size_t count, loff_t *ppos)
+{
+	mutex_lock(&ra_replay_mutex);
+	ra_replay_files = ra_replay_failed = ra_replay_bad = 0;
+	ra_replay_pages = ra_replay_read = ra_replay_used = 0;
+	mutex_unlock(&ra_replay_mutex);
+	return count;
+}
+
+static const struct file_operations ra_stats_fops = {
+	.open		= ra_stats_open,
+	.read		= seq_read,
+	.write		= ra_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init ra_trace_init(void)
+{
+	struct proc_dir_entry *dir;
+
+	dir = proc_mkdir("readahead", NULL);
+	if (!dir)
+		return -ENOMEM;
+	proc_create("record", S_IWUSR, dir, &ra_record_fops);
+	proc_create("trace", S_IRUSR | S_IWUSR, dir, &ra_trace_fops);
+	proc_create("stats", S_IRUGO | S_IWUSR, dir, &ra_stats_fops);
+	return 0;
+}
+module_init(ra_trace_init);
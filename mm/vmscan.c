@@ -2179,6 +2179,7 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 				gfp_t gfp_mask, nodemask_t *nodemask)
 {
 	unsigned long nr_reclaimed;
+	u64 start;
 	struct scan_control sc = {
 		.gfp_mask = gfp_mask,
 		.may_writepage = !laptop_mode,
@@ -2198,7 +2199,11 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 				sc.may_writepage,
 				gfp_mask);
 
+	start = local_clock();
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc, &shrink);
+	/* Time allocating tasks spent stalled in reclaim */
+	count_vm_events(ALLOCSTALL_US,
+			div_u64(local_clock() - start, NSEC_PER_USEC));
 
 	trace_mm_vmscan_direct_reclaim_end(nr_reclaimed);
 
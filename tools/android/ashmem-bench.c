@@ -0,0 +1,264 @@
+/*
+ * ashmem-bench: time ASHMEM_PIN, ASHMEM_UNPIN and ASHMEM_GET_PIN_STATUS on
+ * an area with thousands of unpinned ranges.
+ *
+ * The area is mapped and every other page is unpinned, which leaves one
+ * unpinned range per two pages. Random pin, unpin and status calls of one
+ * to eight pages then run against it, and the average cost of each kind is
+ * printed. With a linear walk of the unpinned ranges, this cost grows with
+ * the number of pages; with a tree it should barely move as -p grows.
+ *
+ * With -m, a child process repeatedly maps, touches and unmaps that many
+ * megabytes of anonymous memory while the calls run. Once that exceeds
+ * free memory, the ashmem shrinker purges unpinned ranges concurrently
+ * with pinning and unpinning, and the latencies show how long the calls
+ * wait on it. The number of pins that found their pages purged shows
+ * whether the shrinker ran at all.
+ *
+ * Every call is also checked against a bitmap of the pages unpinned so
+ * far: a status call must report unpinned exactly when one of its pages
+ * is. Purging unpinned pages does not change their pin state.
+ *
+ * Usage: ashmem-bench [-p pages] [-n operations] [-s seed] [-m megabytes]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <linux/types.h>
+
+#include "../../include/linux/ashmem.h"
+
+#define MAX_RUN		8
+#define NR_BUCKETS	40		/* log2 of the call time in ns */
+
+enum { OP_PIN, OP_UNPIN, OP_STATUS, NR_OPS };
+
+static const char *op_names[NR_OPS] = { "pin", "unpin", "status" };
+static const int op_cmds[NR_OPS] = {
+	ASHMEM_PIN, ASHMEM_UNPIN, ASHMEM_GET_PIN_STATUS
+};
+
+static long page_size;
+static unsigned char *unpinned;		/* one byte per page */
+static uint64_t op_ns[NR_OPS];
+static uint64_t op_max[NR_OPS];
+static unsigned long op_count[NR_OPS];
+static unsigned long op_hist[NR_OPS][NR_BUCKETS];
+static unsigned long purged_pins;
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* issue one ioctl for pages [start, start + len) and check the result */
+static int do_op(int fd, int op, size_t start, size_t len)
+{
+	struct ashmem_pin pin;
+	uint64_t t;
+	size_t i;
+	int ret, expect, b;
+
+	pin.offset = start * page_size;
+	pin.len = len * page_size;
+	t = now_ns();
+	ret = ioctl(fd, op_cmds[op], &pin);
+	t = now_ns() - t;
+	if (ret < 0)
+		die(op_names[op]);
+
+	op_ns[op] += t;
+	op_count[op]++;
+	if (t > op_max[op])
+		op_max[op] = t;
+	for (b = 0; b < NR_BUCKETS - 1 && t >> (b + 1); b++)
+		;
+	op_hist[op][b]++;
+
+	switch (op) {
+	case OP_PIN:
+		if (ret == ASHMEM_WAS_PURGED)
+			purged_pins++;
+		memset(unpinned + start, 0, len);
+		break;
+	case OP_UNPIN:
+		memset(unpinned + start, 1, len);
+		break;
+	case OP_STATUS:
+		expect = ASHMEM_IS_PINNED;
+		for (i = start; i < start + len; i++)
+			if (unpinned[i])
+				expect = ASHMEM_IS_UNPINNED;
+		if (ret != expect) {
+			fprintf(stderr, "status of pages %zu-%zu: got %d, "
+				"expected %d\n", start, start + len - 1,
+				ret, expect);
+			return 1;
+		}
+		break;
+	}
+
+	return 0;
+}
+
+/* upper bound, in ns, of the bucket holding the given fraction of calls */
+static uint64_t percentile(int op, double fraction)
+{
+	unsigned long seen = 0;
+	int b;
+
+	for (b = 0; b < NR_BUCKETS; b++) {
+		seen += op_hist[op][b];
+		if (seen >= fraction * op_count[op])
+			break;
+	}
+	return 2ULL << b;
+}
+
+/* keep cycling through 'mb' megabytes of anonymous memory until killed */
+static pid_t start_pressure(size_t mb)
+{
+	size_t size = mb << 20, off;
+	pid_t pid;
+	char *p;
+
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (pid)
+		return pid;
+
+	/* don't outlive a benchmark that dies on an error */
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	for (;;) {
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			die("mmap pressure");
+		for (off = 0; off < size; off += page_size)
+			p[off] = 1;
+		munmap(p, size);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long nr_ops = 1000000, i;
+	size_t pages = 8192, pressure_mb = 0, start, len;
+	unsigned int seed = 1;
+	int fd, op, opt, bad = 0;
+	pid_t pressure = 0;
+	void *map;
+
+	while ((opt = getopt(argc, argv, "p:n:s:m:")) != -1) {
+		switch (opt) {
+		case 'p':
+			pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_ops = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			pressure_mb = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p pages] [-n operations] "
+				"[-s seed] [-m megabytes]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (pages < 2 * MAX_RUN)
+		pages = 2 * MAX_RUN;
+	srand(seed);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	unpinned = calloc(pages, 1);
+	if (!unpinned)
+		die("calloc");
+
+	fd = open("/dev/ashmem", O_RDWR);
+	if (fd < 0)
+		die("open /dev/ashmem");
+	if (ioctl(fd, ASHMEM_SET_SIZE, pages * page_size) < 0)
+		die("ASHMEM_SET_SIZE");
+	/* the area has no backing file, and so cannot be pinned, until mapped */
+	map = mmap(NULL, pages * page_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		die("mmap");
+	memset(map, 0xa5, pages * page_size);
+
+	for (start = 0; start < pages; start += 2)
+		bad |= do_op(fd, OP_UNPIN, start, 1);
+	printf("%zu pages, %zu unpinned ranges set up in %.1f ms\n",
+	       pages, (pages + 1) / 2, op_ns[OP_UNPIN] / 1e6);
+	op_ns[OP_UNPIN] = 0;
+	op_max[OP_UNPIN] = 0;
+	op_count[OP_UNPIN] = 0;
+	memset(op_hist[OP_UNPIN], 0, sizeof(op_hist[OP_UNPIN]));
+
+	if (pressure_mb) {
+		pressure = start_pressure(pressure_mb);
+		printf("cycling %zu MB of anonymous memory in pid %d\n",
+		       pressure_mb, (int)pressure);
+	}
+
+	for (i = 0; i < nr_ops && !bad; i++) {
+		op = rand() % NR_OPS;
+		len = 1 + rand() % MAX_RUN;
+		start = rand() % (pages - len + 1);
+		bad |= do_op(fd, op, start, len);
+	}
+
+	if (pressure) {
+		kill(pressure, SIGKILL);
+		waitpid(pressure, NULL, 0);
+	}
+
+	for (op = 0; op < NR_OPS; op++) {
+		if (!op_count[op])
+			continue;
+		printf("%-7s %9lu calls, %8.0f ns/call, p50 < %llu ns, "
+		       "p99 < %llu ns, max %llu ns\n", op_names[op],
+		       op_count[op], (double)op_ns[op] / op_count[op],
+		       (unsigned long long)percentile(op, 0.5),
+		       (unsigned long long)percentile(op, 0.99),
+		       (unsigned long long)op_max[op]);
+	}
+	printf("%lu pins found purged pages\n", purged_pins);
+
+	/* pinning the whole area must leave nothing unpinned */
+	bad |= do_op(fd, OP_PIN, 0, pages);
+	bad |= do_op(fd, OP_STATUS, 0, pages);
+
+	munmap(map, pages * page_size);
+	close(fd);
+	free(unpinned);
+
+	if (bad)
+		printf("FAILED\n");
+	return bad;
+}
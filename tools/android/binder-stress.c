@@ -0,0 +1,311 @@
+/*
+ * binder-stress: measure binder transaction throughput as the number of
+ * concurrent client processes grows.
+ *
+ * One server process becomes the binder context manager and answers every
+ * transaction with a status-only reply from a pool of looper threads. For each
+ * client count, that many client processes send synchronous transactions
+ * of the given size to handle 0 for a fixed time, and the total rate is
+ * printed. With a global driver lock the rate stays flat past one or two
+ * clients; it should rise with the number of cores otherwise.
+ *
+ * The context manager can only be set once, so run this where no
+ * servicemanager is running, e.g. from recovery or a minimal rootfs.
+ *
+ * Usage: binder-stress [-c max_clients] [-t seconds] [-s payload_bytes]
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../../drivers/staging/android/binder.h"
+
+#define MAP_SIZE	(1024 * 1024)
+
+static int payload_size = 128;
+
+struct binder_state {
+	int fd;
+	void *map;
+};
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static void binder_setup(struct binder_state *bs)
+{
+	struct binder_version vers;
+
+	bs->fd = open("/dev/binder", O_RDWR);
+	if (bs->fd < 0)
+		die("open /dev/binder");
+	if (ioctl(bs->fd, BINDER_VERSION, &vers) < 0 ||
+	    vers.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder protocol version mismatch\n");
+		exit(1);
+	}
+	bs->map = mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, bs->fd, 0);
+	if (bs->map == MAP_FAILED)
+		die("mmap /dev/binder");
+}
+
+static int binder_io(struct binder_state *bs, void *wbuf, size_t wlen,
+		     void *rbuf, size_t rlen)
+{
+	struct binder_write_read bwr;
+
+	bwr.write_size = wlen;
+	bwr.write_consumed = 0;
+	bwr.write_buffer = (unsigned long)wbuf;
+	bwr.read_size = rlen;
+	bwr.read_consumed = 0;
+	bwr.read_buffer = (unsigned long)rbuf;
+
+	while (ioctl(bs->fd, BINDER_WRITE_READ, &bwr) < 0)
+		if (errno != EINTR)
+			die("BINDER_WRITE_READ");
+	return bwr.read_consumed;
+}
+
+static void binder_cmd(struct binder_state *bs, uint32_t cmd)
+{
+	binder_io(bs, &cmd, sizeof(cmd), NULL, 0);
+}
+
+/*
+ * Walk the returned commands. The transaction, if any, is copied to
+ * @txn and its type is returned; 0 if there was none.
+ */
+static uint32_t parse(char *buf, int len, struct binder_transaction_data *txn)
+{
+	uint32_t cmd, ret = 0;
+	char *end = buf + len;
+
+	while (buf < end) {
+		memcpy(&cmd, buf, sizeof(cmd));
+		buf += sizeof(cmd);
+		switch (cmd) {
+		case BR_TRANSACTION:
+		case BR_REPLY:
+			memcpy(txn, buf, sizeof(*txn));
+			ret = cmd;
+			break;
+		case BR_DEAD_REPLY:
+		case BR_FAILED_REPLY:
+			fprintf(stderr, "transaction failed\n");
+			exit(1);
+		case BR_NOOP:
+		case BR_TRANSACTION_COMPLETE:
+		case BR_SPAWN_LOOPER:
+		case BR_INCREFS:
+		case BR_ACQUIRE:
+		case BR_RELEASE:
+		case BR_DECREFS:
+			break;
+		default:
+			fprintf(stderr, "unexpected binder command %08x\n", cmd);
+			exit(1);
+		}
+		buf += _IOC_SIZE(cmd);
+	}
+	return ret;
+}
+
+struct txn_cmd {
+	uint32_t free_cmd;
+	const void *free_ptr;
+	uint32_t cmd;
+	struct binder_transaction_data txn;
+} __attribute__((packed));
+
+static void *server_thread(void *arg)
+{
+	struct binder_state *bs = arg;
+	struct binder_transaction_data txn;
+	struct txn_cmd reply;
+	uint32_t rbuf[64];
+	int32_t status = 0;
+	int len;
+
+	binder_cmd(bs, BC_ENTER_LOOPER);
+	for (;;) {
+		len = binder_io(bs, NULL, 0, rbuf, sizeof(rbuf));
+		if (parse((char *)rbuf, len, &txn) != BR_TRANSACTION)
+			continue;
+
+		memset(&reply, 0, sizeof(reply));
+		reply.free_cmd = BC_FREE_BUFFER;
+		reply.free_ptr = txn.data.ptr.buffer;
+		reply.cmd = BC_REPLY;
+		reply.txn.data_size = sizeof(status);
+		reply.txn.data.ptr.buffer = &status;
+		binder_io(bs, &reply, sizeof(reply), NULL, 0);
+	}
+	return NULL;
+}
+
+static void run_server(int nr_threads, int ready_fd)
+{
+	struct binder_state bs;
+	pthread_t thread;
+	size_t max = nr_threads;
+	int i;
+
+	binder_setup(&bs);
+	if (ioctl(bs.fd, BINDER_SET_MAX_THREADS, &max) < 0)
+		die("BINDER_SET_MAX_THREADS");
+	if (ioctl(bs.fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		die("BINDER_SET_CONTEXT_MGR (is servicemanager running?)");
+
+	for (i = 1; i < nr_threads; i++)
+		if (pthread_create(&thread, NULL, server_thread, &bs))
+			die("pthread_create");
+	if (write(ready_fd, "", 1) != 1)
+		die("write");
+	close(ready_fd);
+	server_thread(&bs);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_client(int seconds, int result_fd)
+{
+	struct binder_state bs;
+	struct binder_transaction_data txn;
+	struct txn_cmd req;
+	uint32_t rbuf[64];
+	unsigned long count = 0;
+	const void *reply = NULL;
+	char *payload;
+	double end;
+	int len, skip;
+
+	binder_setup(&bs);
+	payload = calloc(1, payload_size);
+	if (!payload)
+		die("calloc");
+
+	end = now() + seconds;
+	while (now() < end) {
+		memset(&req, 0, sizeof(req));
+		req.free_cmd = BC_FREE_BUFFER;
+		req.free_ptr = reply;
+		req.cmd = BC_TRANSACTION;
+		req.txn.target.handle = 0;
+		req.txn.data_size = payload_size;
+		req.txn.data.ptr.buffer = payload;
+
+		/* the first transaction has no reply buffer to free yet */
+		skip = reply ? 0 : sizeof(req.free_cmd) + sizeof(req.free_ptr);
+		binder_io(&bs, (char *)&req + skip, sizeof(req) - skip, NULL, 0);
+		do {
+			len = binder_io(&bs, NULL, 0, rbuf, sizeof(rbuf));
+		} while (parse((char *)rbuf, len, &txn) != BR_REPLY);
+		reply = txn.data.ptr.buffer;
+		count++;
+	}
+
+	if (write(result_fd, &count, sizeof(count)) != sizeof(count))
+		die("write");
+	exit(0);
+}
+
+static unsigned long run_clients(int nr, int seconds)
+{
+	unsigned long total = 0, count;
+	int fds[2], i;
+
+	if (pipe(fds))
+		die("pipe");
+	for (i = 0; i < nr; i++)
+		if (!fork()) {
+			close(fds[0]);
+			run_client(seconds, fds[1]);
+		}
+	close(fds[1]);
+	for (i = 0; i < nr; i++) {
+		if (read(fds[0], &count, sizeof(count)) != sizeof(count)) {
+			fprintf(stderr, "client died\n");
+			exit(1);
+		}
+		total += count;
+	}
+	close(fds[0]);
+	while (wait(NULL) > 0)
+		;
+	return total;
+}
+
+int main(int argc, char **argv)
+{
+	int max_clients = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+	int seconds = 5, fds[2], nr, opt;
+	unsigned long total, base = 0;
+	pid_t server;
+	char c;
+
+	while ((opt = getopt(argc, argv, "c:t:s:")) != -1) {
+		switch (opt) {
+		case 'c':
+			max_clients = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 's':
+			payload_size = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-c max_clients] "
+				"[-t seconds] [-s payload_bytes]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (pipe(fds))
+		die("pipe");
+	server = fork();
+	if (!server) {
+		close(fds[0]);
+		run_server(max_clients, fds[1]);
+	}
+	close(fds[1]);
+	if (read(fds[0], &c, 1) != 1) {
+		fprintf(stderr, "server failed to start\n");
+		return 1;
+	}
+
+	printf("%d cpus, %d byte payload, %d s per run\n",
+	       (int)sysconf(_SC_NPROCESSORS_ONLN), payload_size, seconds);
+	printf("clients   txn/s  scaling\n");
+	for (nr = 1; nr <= max_clients; nr *= 2) {
+		total = run_clients(nr, seconds) / seconds;
+		if (!base)
+			base = total ? total : 1;
+		printf("%7d %7lu  %5.2fx\n", nr, total, (double)total / base);
+	}
+
+	kill(server, SIGKILL);
+	waitpid(server, NULL, 0);
+	return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * logger-bench: measure logger write throughput as the number of writing
+ * threads grows.
+ *
+ * For each thread count, that many threads write entries to the log for a
+ * fixed time, each entry formatted like a liblog message: a priority
+ * byte, a tag and a text payload handed to writev(). The total rate is
+ * printed. If writers serialize on a log-wide lock, the rate stays flat
+ * as threads are added. If they fill in their entries in parallel, it
+ * should rise until every core is busy.
+ *
+ * With -r, one thread also drains the log while the writers run. It
+ * checks that every entry it reads is intact and that each writer's
+ * entries arrive in order.
+ *
+ * Usage: logger-bench [-d device] [-n max_threads] [-t seconds]
+ *                     [-s payload_bytes] [-r]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "../../drivers/staging/android/logger.h"
+
+#define TAG		"logger-bench"
+#define MAX_THREADS	64
+
+static const char *device = "/dev/log/main";
+static int payload_size = 100;
+static volatile int stop;
+static int run_id;		/* tells this run's entries from older ones */
+
+struct writer {
+	pthread_t thread;
+	int id;
+	unsigned long count;
+};
+
+/* every payload byte is derived from the writer and its sequence number */
+static unsigned char pattern(int id, unsigned long seq, int i)
+{
+	return 'a' + (id * 7 + seq + i) % 26;
+}
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static void *writer_thread(void *arg)
+{
+	struct writer *w = arg;
+	unsigned char prio = 4;		/* ANDROID_LOG_INFO */
+	char msg[LOGGER_ENTRY_MAX_PAYLOAD];
+	struct iovec vec[3];
+	int fd, len, i;
+
+	fd = open(device, O_WRONLY);
+	if (fd < 0)
+		die("open log for writing");
+
+	vec[0].iov_base = &prio;
+	vec[0].iov_len = 1;
+	vec[1].iov_base = TAG;
+	vec[1].iov_len = sizeof(TAG);
+	vec[2].iov_base = msg;
+
+	while (!stop) {
+		len = snprintf(msg, sizeof(msg), "%d %d %lu ",
+			       run_id, w->id, w->count);
+		for (i = len; i < payload_size - 1; i++)
+			msg[i] = pattern(w->id, w->count, i);
+		if (i < len)
+			i = len;
+		msg[i++] = '\0';
+		vec[2].iov_len = i;
+
+		if (writev(fd, vec, 3) < 0)
+			die("writev");
+		w->count++;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+struct reader_stats {
+	unsigned long entries;
+	unsigned long bad;
+	unsigned long last[MAX_THREADS];
+	int seen[MAX_THREADS];
+};
+
+/* check one entry read back; returns 0 if it is not one of ours */
+static int check_entry(struct reader_stats *rs, const char *buf, int len)
+{
+	const char *msg;
+	unsigned long seq;
+	int run, id, n, i, mlen;
+
+	if (len < 1 + (int)sizeof(TAG) || memcmp(buf + 1, TAG, sizeof(TAG)))
+		return 0;
+	msg = buf + 1 + sizeof(TAG);
+	mlen = len - 1 - sizeof(TAG);
+
+	if (sscanf(msg, "%d %d %lu %n", &run, &id, &seq, &n) != 3 ||
+	    id < 0 || id >= MAX_THREADS) {
+		rs->bad++;
+		return 1;
+	}
+	if (run != run_id)
+		return 0;
+	for (i = n; i < mlen - 1; i++)
+		if ((unsigned char)msg[i] != pattern(id, seq, i)) {
+			rs->bad++;
+			return 1;
+		}
+	/* entries may be lost to overwriting, but never reordered */
+	if (rs->seen[id] && seq <= rs->last[id])
+		rs->bad++;
+	rs->seen[id] = 1;
+	rs->last[id] = seq;
+	rs->entries++;
+	return 1;
+}
+
+static void *reader_thread(void *arg)
+{
+	struct reader_stats *rs = arg;
+	/* without LOGGER_SET_VERSION, reads return version 1 headers */
+	union {
+		struct user_logger_entry_compat entry;
+		char buf[sizeof(struct user_logger_entry_compat) +
+			 LOGGER_ENTRY_MAX_PAYLOAD];
+	} u;
+	ssize_t ret;
+	int fd;
+
+	fd = open(device, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		die("open log for reading");
+
+	while (!stop) {
+		ret = read(fd, u.buf, sizeof(u.buf));
+		if (ret < 0) {
+			if (errno == EAGAIN) {
+				usleep(1000);
+				continue;
+			}
+			if (errno == EINTR)
+				continue;
+			die("read");
+		}
+		if (ret < (ssize_t)sizeof(u.entry) ||
+		    ret != (ssize_t)sizeof(u.entry) + u.entry.len) {
+			rs->bad++;
+			continue;
+		}
+		check_entry(rs, u.entry.msg, u.entry.len);
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(int nr_threads, int seconds, int verify)
+{
+	static struct writer writers[MAX_THREADS];
+	struct reader_stats rs;
+	pthread_t reader;
+	unsigned long total = 0;
+	double start, elapsed;
+	int i;
+
+	stop = 0;
+	run_id = getpid() * 100 + nr_threads;
+	memset(&rs, 0, sizeof(rs));
+	if (verify && pthread_create(&reader, NULL, reader_thread, &rs))
+		die("pthread_create");
+
+	start = now();
+	for (i = 0; i < nr_threads; i++) {
+		writers[i].id = i;
+		writers[i].count = 0;
+		if (pthread_create(&writers[i].thread, NULL,
+				   writer_thread, &writers[i]))
+			die("pthread_create");
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(writers[i].thread, NULL);
+		total += writers[i].count;
+	}
+	elapsed = now() - start;
+
+	printf("%3d threads: %10.0f writes/s", nr_threads, total / elapsed);
+	if (verify) {
+		pthread_join(reader, NULL);
+		printf(", read back %lu, %lu bad", rs.entries, rs.bad);
+	}
+	printf("\n");
+
+	return verify && rs.bad;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-d device] [-n max_threads] [-t seconds] "
+		"[-s payload_bytes] [-r]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+	int seconds = 5;
+	int verify = 0;
+	int failed = 0;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, "d:n:t:s:r")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'n':
+			max_threads = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 's':
+			payload_size = atoi(optarg);
+			break;
+		case 'r':
+			verify = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (max_threads < 1)
+		max_threads = 1;
+	if (max_threads > MAX_THREADS)
+		max_threads = MAX_THREADS;
+	if (seconds < 1)
+		seconds = 1;
+	if (payload_size < 1)
+		payload_size = 1;
+	if (payload_size > LOGGER_ENTRY_MAX_PAYLOAD - 1 - (int)sizeof(TAG))
+		payload_size = LOGGER_ENTRY_MAX_PAYLOAD - 1 - sizeof(TAG);
+
+	for (n = 1; n <= max_threads; n *= 2)
+		failed |= run(n, seconds, verify);
+
+	return failed;
+}
@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# Run flash-iosched.fio under each io scheduler on a ram backed disk with
+# a fixed service time and one command in flight, and print for each
+# scheduler the reader's completion latency percentiles, the bandwidth of
+# each job and the number of read and write requests the disk received.
+#
+# scsi_debug provides the disk. It has a request queue, so an io
+# scheduler, and completes each command $DELAY jiffies after it is
+# issued. With max_queue=1 it takes one command at a time, as an eMMC
+# without command queueing does, so requests wait in the scheduler and
+# the order it dispatches them in shows up in the latencies. fio runs
+# directly against the scsi_debug disk.
+#
+# Must run as root with fio and scsi_debug available, and with no other
+# scsi_debug disk present. Full fio output for each run is left in
+# $OUT/<scheduler>.txt.
+#
+# usage: flash-iosched-compare.sh [scheduler ...]
+#	default schedulers: noop deadline cfq flash
+#	RUNTIME (seconds, default 60), DELAY (jiffies per command, default
+#	1) and OUT (default ./flash-iosched.out) may be set in the
+#	environment.
+#
+
+SCHEDS=${*:-"noop deadline cfq flash"}
+RUNTIME=${RUNTIME:-60}
+DELAY=${DELAY:-1}
+OUT=${OUT:-./flash-iosched.out}
+JOB=$(dirname "$0")/flash-iosched.fio
+
+die()
+{
+	echo "$0: $*" >&2
+	exit 1
+}
+
+cleanup()
+{
+	modprobe -r scsi_debug 2>/dev/null
+}
+
+[ -r "$JOB" ] || die "cannot find $JOB"
+command -v fio >/dev/null || die "fio not found"
+[ -d /sys/bus/pseudo/drivers/scsi_debug ] && die "scsi_debug already loaded"
+
+modprobe scsi_debug dev_size_mb=1024 delay=$DELAY max_queue=1 ||
+	die "cannot load scsi_debug"
+trap cleanup EXIT INT TERM
+udevadm settle 2>/dev/null
+
+DISK=
+for d in /sys/bus/pseudo/drivers/scsi_debug/adapter*/host*/target*/*/block/*
+do
+	[ -e "$d" ] && DISK=$(basename "$d")
+done
+[ -n "$DISK" ] || die "scsi_debug registered no disk"
+echo 1 > /sys/block/$DISK/device/queue_depth 2>/dev/null
+mkdir -p "$OUT" || die "cannot create $OUT"
+
+# fields 1 and 5 of the stat file: read and write requests completed
+reqs()
+{
+	awk '{ print $1, $5 }' /sys/block/$DISK/stat
+}
+
+for s in $SCHEDS; do
+	if ! echo $s > /sys/block/$DISK/queue/scheduler 2>/dev/null; then
+		echo "$s: not available, skipped"
+		continue
+	fi
+
+	set -- $(reqs)
+	r0=$1 w0=$2
+	DEV=/dev/$DISK RUNTIME=$RUNTIME fio "$JOB" > "$OUT/$s.txt" ||
+		die "fio failed under $s, see $OUT/$s.txt"
+	set -- $(reqs)
+
+	echo "== $s: $(($1 - r0)) read and $(($2 - w0)) write requests to $DISK"
+	# bandwidth of each job, and the reader's clat percentiles
+	grep -E '^(reader|writer|background):|^ *(read|write) *:' "$OUT/$s.txt"
+	awk '/^reader:/ { r = 1 }
+	     /^writer:/ { r = 0 }
+	     r && /clat percentiles/ { p = 1; next }
+	     p && /\|/ { print; next }
+	     { p = 0 }' \
+		"$OUT/$s.txt"
+done
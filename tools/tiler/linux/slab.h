@@ -0,0 +1,39 @@
+#ifndef LINUX_SLAB_H
+#define LINUX_SLAB_H
+/* Just enough of the kernel for tcm-sita.c to build in userspace */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int16_t s16;
+typedef int32_t s32;
+
+#define GFP_KERNEL 0
+#define kmalloc(size, flags) malloc(size)
+#define kfree(p) free(p)
+
+struct mutex {
+	int unused;
+};
+#define mutex_init(m) ((void)(m))
+#define mutex_lock(m) ((void)(m))
+#define mutex_unlock(m) ((void)(m))
+#define mutex_destroy(m) ((void)(m))
+
+#define WARN_ON(cond) ({ int __c = !!(cond); \
+	if (__c) fprintf(stderr, "WARN_ON(%s) at %s:%d\n", #cond, \
+			 __FILE__, __LINE__); __c; })
+#define BUG_ON(cond) do { if (cond) abort(); } while (0)
+#define ALIGN(x, a) (((x) + ((a) - 1)) & ~((typeof(x))(a) - 1))
+
+#define printk printf
+#define KERN_NOTICE ""
+#define KERN_INFO ""
+#define KERN_DEBUG ""
+#endif
@@ -0,0 +1,311 @@
+/*
+ * tcm_replay: replay a trace of tiler container reservations and frees
+ * through the SiTA container manager (tcm-sita.c) in userspace.
+ *
+ * A trace has one operation per line:
+ *	2 <id> <width> <height> <align>		reserve a 2D area
+ *	1 <id> <slots>				reserve a 1D area
+ *	f <id>					free area <id>
+ * Ids are chosen by the trace, from 0 to MAX_AREAS - 1. Reserving an id
+ * that is still live, or freeing one that is not, is skipped.
+ *
+ * With no trace file, a random mix of 1D and 2D reservations and frees is
+ * generated from a seed. Use -g to print that trace instead of replaying
+ * it.
+ *
+ * Each successful reservation prints "<id> <x0> <y0> <x1> <y1>" on
+ * stdout. Two builds of the manager can be compared by diffing that
+ * output for the same trace; "make TCM_DIR=<dir>" builds against the
+ * tcm directory of another tree. Every area is also checked against an
+ * occupancy map of the container: it must lie inside the container and
+ * not overlap any live area. The time spent in the manager and the
+ * number of failed reservations go to stderr.
+ *
+ * Usage: tcm_replay [-w width] [-h height] [-n ops] [-s seed] [-g] [-q]
+ *                   [trace]
+ */
+#include <linux/slab.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tcm-sita.h"
+
+#define MAX_AREAS	4096
+
+static u16 width = 256, height = 128;	/* OMAP4 container, in slots */
+static struct tcm_area areas[MAX_AREAS];
+static bool live[MAX_AREAS];
+static int *owner;			/* id + 1 of the area using a slot */
+static int quiet;
+
+static unsigned long tcm_ns, reserves, failures, errors;
+
+static unsigned long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* mark the slots of area id as owned by it, or as free */
+static void mark(int id, bool set)
+{
+	struct tcm_area *a = &areas[id];
+	int x, y, i, first, last;
+
+	if (a->is2d) {
+		for (y = a->p0.y; y <= a->p1.y; y++)
+			for (x = a->p0.x; x <= a->p1.x; x++) {
+				i = y * width + x;
+				if (set && owner[i]) {
+					fprintf(stderr, "area %d overlaps area "
+						"%d at (%d, %d)\n", id,
+						owner[i] - 1, x, y);
+					errors++;
+				}
+				owner[i] = set ? id + 1 : 0;
+			}
+		return;
+	}
+
+	first = a->p0.y * width + a->p0.x;
+	last = a->p1.y * width + a->p1.x;
+	for (i = first; i <= last; i++) {
+		if (set && owner[i]) {
+			fprintf(stderr, "area %d overlaps area %d at slot %d\n",
+				id, owner[i] - 1, i);
+			errors++;
+		}
+		owner[i] = set ? id + 1 : 0;
+	}
+}
+
+static bool in_container(struct tcm_area *a)
+{
+	if (a->p0.x >= width || a->p1.x >= width ||
+	    a->p0.y >= height || a->p1.y >= height)
+		return false;
+	if (a->is2d)
+		return a->p0.x <= a->p1.x && a->p0.y <= a->p1.y;
+	return a->p0.y * width + a->p0.x <= a->p1.y * width + a->p1.x;
+}
+
+static void do_reserve(struct tcm *tcm, int id, bool is2d, u32 w, u32 h,
+		       u32 align)
+{
+	unsigned long t;
+	s32 ret;
+
+	if (id < 0 || id >= MAX_AREAS || live[id])
+		return;
+
+	t = now_ns();
+	if (is2d)
+		ret = tcm_reserve_2d(tcm, w, h, align, &areas[id]);
+	else
+		ret = tcm_reserve_1d(tcm, w, &areas[id]);
+	tcm_ns += now_ns() - t;
+	reserves++;
+
+	if (ret) {
+		failures++;
+		return;
+	}
+
+	if (!in_container(&areas[id])) {
+		fprintf(stderr, "area %d (%d %d)-(%d %d) outside container\n",
+			id, areas[id].p0.x, areas[id].p0.y, areas[id].p1.x,
+			areas[id].p1.y);
+		errors++;
+	} else {
+		mark(id, true);
+	}
+	live[id] = true;
+
+	if (!quiet)
+		printf("%d %d %d %d %d\n", id, areas[id].p0.x, areas[id].p0.y,
+		       areas[id].p1.x, areas[id].p1.y);
+}
+
+static void do_free(int id)
+{
+	unsigned long t;
+
+	if (id < 0 || id >= MAX_AREAS || !live[id])
+		return;
+
+	if (in_container(&areas[id]))
+		mark(id, false);
+
+	t = now_ns();
+	tcm_free(&areas[id]);
+	tcm_ns += now_ns() - t;
+	live[id] = false;
+}
+
+static int replay_file(struct tcm *tcm, FILE *f)
+{
+	char line[128], op;
+	int id, n;
+	u32 a, b, c;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, " %c%n", &op, &n) != 1 || op == '#')
+			continue;
+		switch (op) {
+		case '2':
+			if (sscanf(line + n, "%d %u %u %u", &id, &a, &b, &c) != 4)
+				goto bad;
+			do_reserve(tcm, id, true, a, b, c);
+			break;
+		case '1':
+			if (sscanf(line + n, "%d %u", &id, &a) != 2)
+				goto bad;
+			do_reserve(tcm, id, false, a, 0, 0);
+			break;
+		case 'f':
+			if (sscanf(line + n, "%d", &id) != 1)
+				goto bad;
+			do_free(id);
+			break;
+		default:
+			goto bad;
+		}
+	}
+	return 0;
+bad:
+	fprintf(stderr, "bad trace line: %s", line);
+	return 1;
+}
+
+static u32 next_rand(u32 *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+/*
+ * A random mix resembling tiler use: mostly 2D buffers of up to 64x48
+ * slots at 1, 32 or 64 slot alignment, and some 1D buffers of up to 512
+ * slots, over a working set of 400 ids.
+ */
+static void random_trace(struct tcm *tcm, u32 seed, long ops, bool print)
+{
+	static const u32 aligns[] = { 1, 32, 64 };
+	u32 r, w, h, align;
+	long i;
+	int id;
+
+	for (i = 0; i < ops; i++) {
+		id = next_rand(&seed) % 400;
+		if (live[id]) {
+			if (print) {
+				printf("f %d\n", id);
+				live[id] = false;
+			} else {
+				do_free(id);
+			}
+			continue;
+		}
+
+		r = next_rand(&seed);
+		if (r % 5 == 0) {
+			w = 1 + (r >> 3) % 512;
+			if (print) {
+				printf("1 %d %u\n", id, w);
+				live[id] = true;
+			} else {
+				do_reserve(tcm, id, false, w, 0, 0);
+			}
+		} else {
+			w = 1 + (r >> 3) % 64;
+			h = 1 + (r >> 9) % 48;
+			align = aligns[(r >> 15) % 3];
+			if (print) {
+				printf("2 %d %u %u %u\n", id, w, h, align);
+				live[id] = true;
+			} else {
+				do_reserve(tcm, id, true, w, h, align);
+			}
+		}
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-w width] [-h height] [-n ops] [-s seed] "
+		"[-g] [-q] [trace]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct tcm *tcm;
+	long ops = 200000;
+	u32 seed = 1;
+	bool gen = false;
+	FILE *f;
+	int opt, ret = 0, id;
+
+	while ((opt = getopt(argc, argv, "w:h:n:s:gq")) != -1) {
+		switch (opt) {
+		case 'w':
+			width = atoi(optarg);
+			break;
+		case 'h':
+			height = atoi(optarg);
+			break;
+		case 'n':
+			ops = atol(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			gen = true;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (gen) {
+		random_trace(NULL, seed, ops, true);
+		return 0;
+	}
+
+	tcm = sita_init(width, height, NULL);
+	owner = calloc((size_t)width * height, sizeof(*owner));
+	if (!tcm || !owner) {
+		fprintf(stderr, "cannot set up a %ux%u container\n", width,
+			height);
+		return 1;
+	}
+
+	if (optind < argc) {
+		f = fopen(argv[optind], "r");
+		if (!f) {
+			perror(argv[optind]);
+			return 1;
+		}
+		ret = replay_file(tcm, f);
+		fclose(f);
+	} else {
+		random_trace(tcm, seed, ops, false);
+	}
+
+	for (id = 0; id < MAX_AREAS; id++)
+		do_free(id);
+	tcm_deinit(tcm);
+	free(owner);
+
+	fprintf(stderr, "%lu reservations, %lu failed, %lu errors, "
+		"%.3f s in the container manager\n", reserves, failures,
+		errors, tcm_ns / 1e9);
+	return ret || errors;
+}
@@ -0,0 +1,20 @@
+#ifndef ASM_UNALIGNED_H
+#define ASM_UNALIGNED_H
+/* Little endian hosts only, like the ARM targets zram runs on */
+#include <linux/kernel.h>
+
+#define get_unaligned(p) ({ const struct { typeof(*(p)) v; } \
+	__attribute__((packed)) *__p = (const void *)(p); __p->v; })
+#define put_unaligned(val, p) do { struct { typeof(*(p)) v; } \
+	__attribute__((packed)) *__p = (void *)(p); __p->v = (val); } while (0)
+
+static inline u16 get_unaligned_le16(const void *p)
+{
+	return get_unaligned((const u16 *)p);
+}
+
+static inline void put_unaligned_le16(u16 v, void *p)
+{
+	put_unaligned(v, (u16 *)p);
+}
+#endif
@@ -0,0 +1,247 @@
+/*
+ * comp_bench: compare the zram compression backends, LZO and LZ4, on the
+ * same data, using the compressors in lib/lzo and lib/lz4 built for
+ * userspace.
+ *
+ * The input files are cut into 4K pages, as zram sees them. Pages filled
+ * with one repeated word are counted and left out, since zram stores
+ * those without compressing them. Every other page is compressed and
+ * decompressed by each backend, and the result checked against the
+ * original. For each backend this prints:
+ *
+ *	ratio	input bytes over the bytes zram would store. A page that
+ *		compresses to more than 3/4 of a page is stored whole, as
+ *		zram_write() does.
+ *	huge	pages stored whole for that reason
+ *	comp	compression throughput, in MB/s of input
+ *	decomp	decompression throughput, in MB/s of output
+ *
+ * Throughput is the best of -r rounds. Realistic input is a dump of
+ * anonymous memory, e.g. a swap partition or a core file of a running
+ * app; -l caps how much of it is read.
+ *
+ * Usage: comp_bench [-r rounds] [-l megabytes] file...
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/kernel.h>
+#include <linux/lzo.h>
+#include <linux/lz4.h>
+
+#define PAGE_SIZE	4096
+#define MAX_ZPAGE_SIZE	(PAGE_SIZE / 4 * 3)	/* as in zram_drv.h */
+#define DST_SIZE	(2 * PAGE_SIZE)
+
+struct backend {
+	const char *name;
+	size_t workmem_size;
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len);
+};
+
+static const struct backend backends[] = {
+	{ "lzo", LZO1X_MEM_COMPRESS, lzo1x_1_compress,
+	  lzo1x_decompress_safe },
+	{ "lz4", LZ4_MEM_COMPRESS, lz4_compress,
+	  lz4_decompress_unknownoutputsize },
+};
+
+#define NR_BACKENDS	(sizeof(backends) / sizeof(backends[0]))
+
+static unsigned char *data;
+static size_t nr_pages, nr_same;
+static unsigned char *same;		/* one flag per page */
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int page_same_filled(const unsigned char *page)
+{
+	const unsigned long *p = (const unsigned long *)page;
+	size_t i;
+
+	for (i = 1; i < PAGE_SIZE / sizeof(*p); i++)
+		if (p[i] != p[0])
+			return 0;
+	return 1;
+}
+
+/* append whole pages of 'path' to data, stopping at 'limit' pages */
+static void read_file(const char *path, size_t limit)
+{
+	FILE *f;
+	size_t n;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (nr_pages < limit) {
+		n = fread(data + nr_pages * PAGE_SIZE, 1, PAGE_SIZE, f);
+		if (n < PAGE_SIZE)
+			break;
+		nr_pages++;
+	}
+	fclose(f);
+}
+
+static int run(const struct backend *b, int rounds)
+{
+	unsigned char *dst, *out, *cbuf;
+	size_t *clen, stored = 0, huge = 0, len, i;
+	double t, best_c = 0, best_d = 0;
+	void *wrkmem;
+	int r, bad = 0;
+
+	wrkmem = malloc(b->workmem_size);
+	dst = malloc(DST_SIZE);
+	out = malloc(PAGE_SIZE);
+	/* keep every compressed page so decompression is timed on its own */
+	cbuf = malloc(nr_pages * DST_SIZE);
+	clen = calloc(nr_pages, sizeof(*clen));
+	if (!wrkmem || !dst || !out || !cbuf || !clen) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (r = 0; r < rounds; r++) {
+		t = now();
+		for (i = 0; i < nr_pages; i++) {
+			if (same[i])
+				continue;
+			len = DST_SIZE;
+			if (b->compress(data + i * PAGE_SIZE, PAGE_SIZE,
+					cbuf + i * DST_SIZE, &len, wrkmem)) {
+				fprintf(stderr, "%s: page %zu: compress "
+					"failed\n", b->name, i);
+				return 1;
+			}
+			clen[i] = len;
+		}
+		t = now() - t;
+		if (!best_c || t < best_c)
+			best_c = t;
+
+		t = now();
+		for (i = 0; i < nr_pages; i++) {
+			if (same[i])
+				continue;
+			len = PAGE_SIZE;
+			if (b->decompress(cbuf + i * DST_SIZE, clen[i], out,
+					  &len) || len != PAGE_SIZE)
+				bad++;
+		}
+		t = now() - t;
+		if (!best_d || t < best_d)
+			best_d = t;
+	}
+
+	/* check the round trip outside the timed loop */
+	for (i = 0; i < nr_pages; i++) {
+		if (same[i])
+			continue;
+		len = PAGE_SIZE;
+		if (b->decompress(cbuf + i * DST_SIZE, clen[i], out, &len) ||
+		    len != PAGE_SIZE ||
+		    memcmp(out, data + i * PAGE_SIZE, PAGE_SIZE)) {
+			fprintf(stderr, "%s: page %zu does not round trip\n",
+				b->name, i);
+			bad++;
+		}
+		if (clen[i] > MAX_ZPAGE_SIZE) {
+			stored += PAGE_SIZE;
+			huge++;
+		} else {
+			stored += clen[i];
+		}
+	}
+
+	len = (nr_pages - nr_same) * PAGE_SIZE;
+	printf("%-4s %6.2f %8zu %9.1f %9.1f\n", b->name,
+	       stored ? (double)len / stored : 0.0, huge,
+	       best_c ? len / best_c / 1e6 : 0.0,
+	       best_d ? len / best_d / 1e6 : 0.0);
+
+	free(wrkmem);
+	free(dst);
+	free(out);
+	free(cbuf);
+	free(clen);
+	return bad != 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-r rounds] [-l megabytes] file...\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	size_t limit = 256, max_pages, i;
+	int rounds = 5, opt, failed = 0;
+
+	while ((opt = getopt(argc, argv, "r:l:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'l':
+			limit = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind >= argc)
+		usage(argv[0]);
+	if (rounds < 1)
+		rounds = 1;
+
+	max_pages = (limit << 20) / PAGE_SIZE;
+	data = malloc(max_pages * PAGE_SIZE);
+	if (!data) {
+		fprintf(stderr, "cannot allocate %zu MB\n", limit);
+		return 1;
+	}
+	for (; optind < argc && nr_pages < max_pages; optind++)
+		read_file(argv[optind], max_pages);
+	if (!nr_pages) {
+		fprintf(stderr, "no whole pages read\n");
+		return 1;
+	}
+
+	same = calloc(nr_pages, 1);
+	if (!same)
+		return 1;
+	for (i = 0; i < nr_pages; i++)
+		if (page_same_filled(data + i * PAGE_SIZE)) {
+			same[i] = 1;
+			nr_same++;
+		}
+
+	printf("%zu pages, %zu same-filled and left out\n", nr_pages,
+	       nr_same);
+	if (nr_same == nr_pages)
+		return 0;
+	printf("     %6s %8s %9s %9s\n", "ratio", "huge", "comp", "decomp");
+	for (i = 0; i < NR_BACKENDS; i++)
+		failed |= run(&backends[i], rounds);
+
+	free(same);
+	free(data);
+	return failed;
+}
@@ -0,0 +1,15 @@
+#ifndef LINUX_KERNEL_H
+#define LINUX_KERNEL_H
+/* Just enough of the kernel for lib/lzo and lib/lz4 to build in userspace */
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define noinline __attribute__((noinline))
+#endif
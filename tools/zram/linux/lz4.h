@@ -0,0 +1 @@
+#include "../../../include/linux/lz4.h"
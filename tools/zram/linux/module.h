@@ -0,0 +1,7 @@
+#ifndef LINUX_MODULE_H
+#define LINUX_MODULE_H
+#define EXPORT_SYMBOL(sym)
+#define EXPORT_SYMBOL_GPL(sym)
+#define MODULE_LICENSE(l)
+#define MODULE_DESCRIPTION(d)
+#endif